@@ -0,0 +1,81 @@
+#include "aho_corasick.h"
+
+#include <algorithm>
+#include <queue>
+
+aho_corasick::aho_corasick(const std::vector<std::string> &patterns) {
+    std::fill(classes, classes + 256, 0);
+    number_of_classes = 1;
+    for (const std::string &pattern : patterns) {
+        for (char c : pattern) {
+            std::uint8_t &cls = classes[static_cast<std::uint8_t>(c)];
+            if (cls == 0) cls = static_cast<std::uint8_t>(number_of_classes++);
+        }
+    }
+    const std::uint32_t NONE = UINT32_MAX;
+    auto new_state = [&]() {
+        transitions.resize(transitions.size() + number_of_classes, NONE);
+        outputs.push_back(-1);
+        output_links.push_back(0);
+        return static_cast<std::uint32_t>(outputs.size() - 1);
+    };
+    new_state();
+    for (std::size_t i = 0; i < patterns.size(); i++) {
+        std::uint32_t state = 0;
+        for (char c : patterns[i]) {
+            std::size_t k = state * number_of_classes + classes[static_cast<std::uint8_t>(c)];
+            if (transitions[k] == NONE) {
+                std::uint32_t next = new_state();
+                transitions[k] = next;
+            }
+            state = transitions[k];
+        }
+        if (outputs[state] < 0) outputs[state] = static_cast<std::int32_t>(i);
+        lengths.push_back(patterns[i].size());
+    }
+
+    /* breadth first, so the failure of a state is complete before its children */
+    std::vector<std::uint32_t> failures(outputs.size(), 0);
+    std::queue<std::uint32_t> queue;
+    for (std::size_t k = 0; k < number_of_classes; k++) {
+        std::uint32_t &next = transitions[k];
+        if (next == NONE) {
+            next = 0;
+        } else {
+            queue.push(next);
+        }
+    }
+    while (!queue.empty()) {
+        std::uint32_t state = queue.front();
+        queue.pop();
+        std::uint32_t failure = failures[state];
+        for (std::size_t k = 0; k < number_of_classes; k++) {
+            std::uint32_t &next = transitions[state * number_of_classes + k];
+            std::uint32_t fallback = transitions[failure * number_of_classes + k];
+            if (next == NONE) {
+                next = fallback;
+            } else {
+                failures[next] = fallback;
+                output_links[next] = outputs[fallback] >= 0 ? fallback : output_links[fallback];
+                queue.push(next);
+            }
+        }
+    }
+}
+
+bool aho_corasick::scan(std::uint32_t &state, char const *data, std::size_t len, std::uint64_t base,
+                        const std::function<bool(std::size_t, std::uint64_t)> &on_match) const {
+    std::uint32_t s = state;
+    for (std::size_t i = 0; i < len; i++) {
+        s = transitions[s * number_of_classes + classes[static_cast<std::uint8_t>(data[i])]];
+        for (std::uint32_t o = outputs[s] >= 0 ? s : output_links[s]; o != 0; o = output_links[o]) {
+            std::size_t pattern = static_cast<std::size_t>(outputs[o]);
+            if (!on_match(pattern, base + i + 1 - lengths[pattern])) {
+                state = s;
+                return false;
+            }
+        }
+    }
+    state = s;
+    return true;
+}
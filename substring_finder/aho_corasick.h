@@ -0,0 +1,39 @@
+#ifndef AHO_CORASICK_H
+#define AHO_CORASICK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Automaton finding many distinct non-empty patterns in one pass, built once
+ * and shared by the verifying threads. Bytes which occur in no pattern share
+ * one column of the transition table.
+ */
+class aho_corasick {
+    std::uint8_t classes[256];
+    std::size_t number_of_classes;
+    std::vector<std::uint32_t> transitions;
+    /* the pattern ending in a state or -1 */
+    std::vector<std::int32_t> outputs;
+    /* the next state on the chain of failures which has an output, 0 if none */
+    std::vector<std::uint32_t> output_links;
+    std::vector<std::size_t> lengths;
+
+public:
+    explicit aho_corasick(const std::vector<std::string> &patterns);
+
+    std::size_t size() const { return lengths.size(); }
+
+    /*
+     * Calls on_match(pattern, offset) for every occurrence ending in data, base
+     * is the offset of data. Text may be scanned in pieces, carrying the state
+     * which starts at 0. False if on_match stopped the scan.
+     */
+    bool scan(std::uint32_t &state, char const *data, std::size_t len, std::uint64_t base,
+              const std::function<bool(std::size_t, std::uint64_t)> &on_match) const;
+};
+
+#endif // AHO_CORASICK_H
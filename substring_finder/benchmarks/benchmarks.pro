@@ -0,0 +1,15 @@
+# Throughput of the vectorized kernels, without Qt:
+#   qmake benchmarks.pro && make && ./kernels [megabytes]
+
+TEMPLATE = app
+TARGET = kernels
+CONFIG += console c++14
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    kernels.cpp \
+    ../substring_matcher.cpp \
+    ../text_detector.cpp \
+    ../trigram_extractor.cpp
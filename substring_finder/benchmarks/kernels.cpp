@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "substring_matcher.h"
+#include "text_detector.h"
+#include "trigram_extractor.h"
+#include "utf8_validator.hpp"
+
+namespace {
+    /* text of words, spaces and newlines, mostly ASCII like source code */
+    std::string make_text(std::size_t size) {
+        std::mt19937 random(42);
+        std::string text;
+        text.reserve(size);
+        while (text.size() < size) {
+            std::size_t word = 1 + random() % 10;
+            for (std::size_t i = 0; i < word; i++) text.push_back(static_cast<char>('a' + random() % 26));
+            text.push_back(random() % 8 == 0 ? '\n' : ' ');
+        }
+        text.resize(size);
+        return text;
+    }
+
+    /* runs the body a few times and prints the best throughput */
+    template<typename F>
+    void measure(char const *name, char const *kernel, std::size_t bytes, F body) {
+        double best = 0;
+        for (int run = 0; run < 5; run++) {
+            auto started = std::chrono::steady_clock::now();
+            body();
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - started;
+            best = std::max(best, bytes / seconds.count() / 1e9);
+        }
+        std::printf("%-24s %-8s %6.2f GB/s\n", name, kernel, best);
+    }
+}
+
+int main(int argc, char **argv) {
+    std::size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    std::string text = make_text(megabytes << 20);
+
+    std::vector<trigram> codes(text.size());
+    measure("trigram codes", trigram_extractor::kernel_name(), text.size(), [&] {
+        trigram_extractor::extract(text.data(), text.size(), codes.data());
+    });
+    trigram_set set;
+    measure("trigram set", trigram_extractor::kernel_name(), text.size(), [&] {
+        trigram_extractor extractor;
+        extractor.feed(text.data(), text.size(), set);
+        set.finish();
+        set.clear();
+    });
+
+    /* the digit never occurs in the text, so every byte is looked at */
+    substring_matcher matcher("needle7");
+    std::int64_t found = 0;
+    measure("substring find", substring_matcher::kernel_name(), text.size(), [&] {
+        found += matcher.find(text.data(), text.size());
+    });
+    measure("substring find", "std", text.size(), [&] {
+        found += static_cast<std::int64_t>(text.find("needle7"));
+    });
+
+    std::uint32_t rejected = 0;
+    measure("utf-8 validation", text_detector::kernel_name(), text.size(), [&] {
+        std::uint32_t state = UTF8_ACCEPT;
+        rejected |= text_detector::validate(&state, text.data(), text.size());
+    });
+    measure("utf-8 validation", "scalar", text.size(), [&] {
+        std::uint32_t state = UTF8_ACCEPT;
+        rejected |= validate_utf8(&state, text.data(), text.size());
+    });
+    return found == 0 || rejected != UTF8_ACCEPT;
+}
@@ -0,0 +1,58 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/*
+ * Blocking queue of limited capacity: push waits while it is full, pop waits
+ * while it is empty. After close() pushes are dropped and pop returns false
+ * once the remaining items are taken.
+ */
+template <typename T>
+class bounded_queue {
+    std::mutex lock;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<T> items;
+    std::size_t capacity;
+    bool closed = false;
+
+public:
+    explicit bounded_queue(std::size_t capacity) : capacity(capacity) {}
+
+    bool push(T item) {
+        std::unique_lock<std::mutex> guard(lock);
+        not_full.wait(guard, [this] { return closed || items.size() < capacity; });
+        if (closed) return false;
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> guard(lock);
+        not_empty.wait(guard, [this] { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    std::size_t size() {
+        std::lock_guard<std::mutex> guard(lock);
+        return items.size();
+    }
+};
+
+#endif // BOUNDED_QUEUE_HPP
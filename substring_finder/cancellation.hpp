@@ -0,0 +1,53 @@
+#ifndef CANCELLATION_HPP
+#define CANCELLATION_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+/*
+ * Shared between the thread which controls a long operation and the threads
+ * doing it. Workers call checkpoint() between small pieces of work: it blocks
+ * while the operation is paused and returns false once it is canceled.
+ */
+class cancellation_token {
+    enum { RUNNING, PAUSED, CANCELED };
+
+    std::atomic<int> state;
+    std::mutex lock;
+    std::condition_variable resumed;
+
+    void set(int value) {
+        std::lock_guard<std::mutex> guard(lock);
+        state = value;
+        resumed.notify_all();
+    }
+
+public:
+    cancellation_token() : state(RUNNING) {}
+
+    void pause() {
+        int expected = RUNNING;
+        state.compare_exchange_strong(expected, PAUSED);
+    }
+    void resume() {
+        std::lock_guard<std::mutex> guard(lock);
+        int expected = PAUSED;
+        state.compare_exchange_strong(expected, RUNNING);
+        resumed.notify_all();
+    }
+    void cancel() { set(CANCELED); }
+    void reset() { set(RUNNING); }
+
+    bool is_paused() const { return state == PAUSED; }
+    bool is_canceled() const { return state == CANCELED; }
+
+    bool checkpoint() {
+        if (state == RUNNING) return true;
+        std::unique_lock<std::mutex> guard(lock);
+        resumed.wait(guard, [this] { return state != PAUSED; });
+        return state != CANCELED;
+    }
+};
+
+#endif // CANCELLATION_HPP
@@ -0,0 +1,31 @@
+#ifndef CASE_FOLDING_H
+#define CASE_FOLDING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* simple case folding of one code point, statuses C and S of CaseFolding.txt */
+std::uint32_t fold_case(std::uint32_t code_point);
+
+/*
+ * Case folded copy of UTF-8 text, optionally with the offset of the original
+ * character every folded byte comes from. Bytes which are not valid UTF-8 are
+ * copied as they are, a character cut at the end of the text is dropped.
+ */
+class folded_text {
+    std::string folded;
+    std::vector<std::uint32_t> origins;
+
+public:
+    void fold(char const *data, std::size_t len, bool with_origins = false);
+
+    const std::string &text() const { return folded; }
+    /* offset in the original text of the folded byte i, i may be the size of the text */
+    std::uint32_t origin(std::size_t i) const { return origins[i]; }
+};
+
+std::string fold_utf8(const std::string &text);
+
+#endif // CASE_FOLDING_H
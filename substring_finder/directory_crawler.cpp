@@ -0,0 +1,142 @@
+#include "directory_crawler.h"
+
+#include <algorithm>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+directory_crawler::directory_crawler(size_t number_of_workers)
+    : pending(0), queued(0), idle(0), stopped(false), number_of_dirs(0), number_of_files(0) {
+    if (number_of_workers == 0) {
+        /* most of the time is spent waiting for the file system, so use more threads than cores */
+        number_of_workers = std::max<size_t>(4, 2 * std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < number_of_workers; i++) {
+        queues.emplace_back(new worker_queue());
+    }
+}
+
+void directory_crawler::push(size_t worker, std::string dir) {
+    pending++;
+    {
+        std::lock_guard<std::mutex> guard(queues[worker]->lock);
+        queues[worker]->dirs.push_back(std::move(dir));
+    }
+    queued++;
+    if (idle > 0) wake(false);
+}
+
+/* taking the lock orders the wakeup after the check of a worker going to sleep */
+void directory_crawler::wake(bool all) {
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+    }
+    if (all) {
+        work_available.notify_all();
+    } else {
+        work_available.notify_one();
+    }
+}
+
+bool directory_crawler::take(size_t worker, std::string &dir) {
+    {
+        worker_queue &own = *queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.dirs.empty()) {
+            dir = std::move(own.dirs.back());
+            own.dirs.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for (size_t k = 1; k < queues.size(); k++) {
+        worker_queue &victim = *queues[(worker + k) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.dirs.empty()) {
+            dir = std::move(victim.dirs.front());
+            victim.dirs.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::int64_t modified_msecs(const struct stat &st) {
+#if defined(__APPLE__)
+    return static_cast<std::int64_t>(st.st_mtimespec.tv_sec) * 1000 + st.st_mtimespec.tv_nsec / 1000000;
+#else
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000;
+#endif
+}
+
+void directory_crawler::walk(size_t worker, const std::string &dir, const std::function<void(crawled_file &&)> &on_file) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) return;
+    DIR *d = ::fdopendir(fd);
+    if (d == nullptr) {
+        ::close(fd);
+        return;
+    }
+    number_of_dirs++;
+    std::string prefix = (!dir.empty() && dir.back() == '/') ? dir : dir + "/";
+    while (struct dirent *entry = ::readdir(d)) {
+        if (token != nullptr && !token->checkpoint()) break;
+        char const *name = entry->d_name;
+        if (name[0] == '.') continue;
+        unsigned char type = entry->d_type;
+        struct stat st;
+        bool stated = false;
+        if (type == DT_UNKNOWN) {
+            if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            stated = true;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+        }
+        if (type == DT_DIR) {
+            push(worker, prefix + name);
+        } else if (type == DT_REG) {
+            if (!stated && ::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            number_of_files++;
+            on_file({prefix + name, static_cast<std::int64_t>(st.st_size), modified_msecs(st)});
+        }
+    }
+    ::closedir(d);
+}
+
+void directory_crawler::work(size_t worker, const std::function<void(crawled_file &&)> &on_file) {
+    std::string dir;
+    for (;;) {
+        if (token != nullptr && !token->checkpoint()) {
+            /* the directories left are never walked, so pending stays above zero */
+            stopped = true;
+            wake(true);
+            return;
+        }
+        if (take(worker, dir)) {
+            walk(worker, dir, on_file);
+            if (--pending == 0) wake(true);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(idle_lock);
+        idle++;
+        work_available.wait(guard, [this] { return queued > 0 || pending == 0 || stopped; });
+        idle--;
+        if (pending == 0 || stopped) return;
+    }
+}
+
+void directory_crawler::crawl(const std::string &root, const std::function<void(crawled_file &&)> &on_file,
+                              cancellation_token *token) {
+    this->token = token;
+    stopped = false;
+    push(0, root);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < queues.size(); i++) {
+        workers.emplace_back(&directory_crawler::work, this, i, std::cref(on_file));
+    }
+    work(0, on_file);
+    for (std::thread &t : workers) t.join();
+}
@@ -0,0 +1,67 @@
+#ifndef DIRECTORY_CRAWLER_H
+#define DIRECTORY_CRAWLER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cancellation.hpp"
+
+struct crawled_file {
+    std::string path;
+    std::int64_t size;
+    /* milliseconds since epoch */
+    std::int64_t modified;
+};
+
+/*
+ * Parallel directory walker. Every worker takes directories from the back of
+ * its own deque and steals from the front of the others when it runs dry.
+ * Workers with nothing to steal sleep until a directory is pushed or the
+ * walk is over.
+ * Entries are classified by d_type, only regular files are stat'ed (relative
+ * to the open directory) to get their size and modification time. Hidden
+ * entries and symbolic links are skipped, as QDir does with our filters.
+ */
+class directory_crawler {
+    struct worker_queue {
+        std::mutex lock;
+        std::deque<std::string> dirs;
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::atomic<size_t> pending;
+    /* directories in the deques, not yet taken */
+    std::atomic<size_t> queued;
+    std::atomic<size_t> idle;
+    std::atomic<bool> stopped;
+    std::mutex idle_lock;
+    std::condition_variable work_available;
+    std::atomic<size_t> number_of_dirs;
+    std::atomic<size_t> number_of_files;
+    cancellation_token *token = nullptr;
+
+    bool take(size_t worker, std::string &dir);
+    void push(size_t worker, std::string dir);
+    void wake(bool all);
+    void walk(size_t worker, const std::string &dir, const std::function<void(crawled_file &&)> &on_file);
+    void work(size_t worker, const std::function<void(crawled_file &&)> &on_file);
+
+public:
+    explicit directory_crawler(size_t number_of_workers = 0);
+
+    /* blocks until the whole tree is walked or the token is canceled, on_file is called from the worker threads */
+    void crawl(const std::string &root, const std::function<void(crawled_file &&)> &on_file,
+               cancellation_token *token = nullptr);
+
+    size_t directories() const { return number_of_dirs; }
+    size_t files() const { return number_of_files; }
+};
+
+#endif // DIRECTORY_CRAWLER_H
@@ -0,0 +1,207 @@
+#include "directory_watcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const std::chrono::milliseconds directory_watcher::QUIET_TIME(200);
+const std::chrono::milliseconds directory_watcher::MAX_DELAY(2000);
+
+directory_watcher::directory_watcher() : number_of_watches(0) {}
+
+#ifdef __linux__
+
+namespace {
+    const std::uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY |
+                                     IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+}
+
+bool directory_watcher::start(const std::string &root, batch_handler handler) {
+    stop();
+    inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify == -1) {
+        return false;
+    }
+    if (::pipe2(wake, O_NONBLOCK | O_CLOEXEC) == -1) {
+        ::close(inotify);
+        inotify = -1;
+        return false;
+    }
+    on_batch = std::move(handler);
+    std::string dir = root;
+    while (dir.size() > 1 && dir.back() == '/') dir.pop_back();
+    add_tree(dir, false);
+    thread = std::thread(&directory_watcher::run, this);
+    return true;
+}
+
+void directory_watcher::stop() {
+    if (thread.joinable()) {
+        char c = 0;
+        while (::write(wake[1], &c, 1) == -1 && errno == EINTR) {}
+        thread.join();
+    }
+    for (int *fd : {&inotify, &wake[0], &wake[1]}) {
+        if (*fd != -1) ::close(*fd);
+        *fd = -1;
+    }
+    directories.clear();
+    pending.clear();
+    overflow = false;
+    number_of_watches = 0;
+}
+
+/*
+ * The watch of a directory is added before it is listed, so a file created
+ * meanwhile is seen either way. Files of a new directory are reported, as
+ * they may have been created before its watch.
+ */
+void directory_watcher::add_tree(const std::string &dir, bool report) {
+    std::vector<std::string> stack = {dir};
+    while (!stack.empty()) {
+        std::string current = std::move(stack.back());
+        stack.pop_back();
+        int wd = ::inotify_add_watch(inotify, current.c_str(), WATCH_MASK);
+        if (wd == -1) {
+            continue;
+        }
+        if (directories.count(wd) == 0) {
+            number_of_watches++;
+        }
+        directories[wd] = current;
+        int fd = ::open(current.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd == -1) continue;
+        DIR *d = ::fdopendir(fd);
+        if (d == nullptr) {
+            ::close(fd);
+            continue;
+        }
+        std::string prefix = current == "/" ? current : current + "/";
+        while (struct dirent *entry = ::readdir(d)) {
+            char const *name = entry->d_name;
+            if (name[0] == '.') continue;
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+            }
+            if (type == DT_DIR) {
+                stack.push_back(prefix + name);
+            } else if (type == DT_REG && report) {
+                pending[prefix + name] = true;
+            }
+        }
+        ::closedir(d);
+    }
+}
+
+/* drops the watches of a directory which is gone or moved away */
+void directory_watcher::forget_tree(const std::string &dir) {
+    std::string prefix = dir + "/";
+    for (auto it = directories.begin(); it != directories.end();) {
+        if (it->second == dir || it->second.compare(0, prefix.size(), prefix) == 0) {
+            ::inotify_rm_watch(inotify, it->first);
+            it = directories.erase(it);
+            number_of_watches--;
+        } else {
+            ++it;
+        }
+    }
+}
+
+void directory_watcher::handle_events(char const *buffer, size_t size) {
+    for (size_t offset = 0; offset < size;) {
+        const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+        offset += sizeof(struct inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW) {
+            overflow = true;
+            continue;
+        }
+        auto it = directories.find(event->wd);
+        if (it == directories.end()) {
+            continue;
+        }
+        if (event->mask & IN_IGNORED) {
+            directories.erase(it);
+            number_of_watches--;
+            continue;
+        }
+        /* events of the directory itself are also reported by its parent */
+        if (event->len == 0 || event->name[0] == '.' || event->name[0] == '\0') {
+            continue;
+        }
+        std::string path = (it->second == "/" ? it->second : it->second + "/") + event->name;
+        bool gone = (event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0;
+        if (event->mask & IN_ISDIR) {
+            if (gone) {
+                forget_tree(path);
+                pending[path] = false;
+            } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                add_tree(path, true);
+            }
+        } else {
+            pending[path] = !gone;
+        }
+    }
+}
+
+void directory_watcher::run() {
+    typedef std::chrono::steady_clock clock;
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    clock::time_point first, last;
+    for (;;) {
+        int timeout = -1;
+        if (!pending.empty() || overflow) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::min(last + QUIET_TIME, first + MAX_DELAY) - clock::now()).count();
+            if (left <= 0) {
+                change_batch batch;
+                for (const auto &change : pending) {
+                    (change.second ? batch.changed : batch.removed).push_back(change.first);
+                }
+                batch.overflow = overflow;
+                pending.clear();
+                overflow = false;
+                on_batch(std::move(batch));
+                continue;
+            }
+            timeout = static_cast<int>(left);
+        }
+        struct pollfd fds[2] = {{inotify, POLLIN, 0}, {wake[0], POLLIN, 0}};
+        if (::poll(fds, 2, timeout) == -1 && errno != EINTR) {
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+        if (fds[0].revents & POLLIN) {
+            bool idle = pending.empty() && !overflow;
+            ssize_t size;
+            while ((size = ::read(inotify, buffer, sizeof(buffer))) > 0) {
+                handle_events(buffer, static_cast<size_t>(size));
+            }
+            last = clock::now();
+            if (idle) first = last;
+        }
+    }
+}
+
+#else
+
+bool directory_watcher::start(const std::string &, batch_handler) {
+    return false;
+}
+
+void directory_watcher::stop() {}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef DIRECTORY_WATCHER_H
+#define DIRECTORY_WATCHER_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Watches a tree with inotify, one watch per directory instead of one per
+ * file, so new files are noticed too. Directories are walked like the crawler
+ * does: hidden entries and symbolic links are skipped. Events are coalesced by
+ * path on a thread of the watcher and handed over in batches, once nothing
+ * happened for QUIET_TIME or MAX_DELAY after the first event of a batch.
+ * Only works on Linux, elsewhere start() fails.
+ */
+class directory_watcher {
+public:
+    struct change_batch {
+        /* files which were created, written or moved in; they may be gone again */
+        std::vector<std::string> changed;
+        /* files or whole directories which were deleted or moved away */
+        std::vector<std::string> removed;
+        /* events were lost, the tree has to be compared with the index */
+        bool overflow = false;
+
+        bool empty() const { return changed.empty() && removed.empty() && !overflow; }
+    };
+    /* called on the thread of the watcher */
+    typedef std::function<void(change_batch &&)> batch_handler;
+
+    static const std::chrono::milliseconds QUIET_TIME;
+    static const std::chrono::milliseconds MAX_DELAY;
+
+private:
+    int inotify = -1;
+    /* written to wake the thread up when it is stopped */
+    int wake[2] = {-1, -1};
+    std::thread thread;
+    batch_handler on_batch;
+    std::unordered_map<int, std::string> directories;
+    /* path -> whether it exists after the last event */
+    std::unordered_map<std::string, bool> pending;
+    bool overflow = false;
+    std::atomic<size_t> number_of_watches;
+
+    void add_tree(const std::string &dir, bool report);
+    void forget_tree(const std::string &dir);
+    void handle_events(char const *buffer, size_t size);
+    void run();
+
+public:
+    directory_watcher();
+    ~directory_watcher() { stop(); }
+
+    /* watches every directory under root, false if inotify cannot be used */
+    bool start(const std::string &root, batch_handler handler);
+    /* the batch which is not handed over yet is dropped */
+    void stop();
+
+    size_t watches() const { return number_of_watches; }
+};
+
+#endif // DIRECTORY_WATCHER_H
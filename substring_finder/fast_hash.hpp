@@ -0,0 +1,133 @@
+#ifndef FAST_HASH_HPP
+#define FAST_HASH_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/* XXH64 by Yann Collet, see https://github.com/Cyan4973/xxHash for details. */
+
+constexpr std::uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ull;
+constexpr std::uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr std::uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ull;
+constexpr std::uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+constexpr std::uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+inline std::uint64_t xxh_rotl(std::uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline std::uint64_t xxh_read64(char const *p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint32_t xxh_read32(char const *p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint64_t xxh_round(std::uint64_t acc, std::uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = xxh_rotl(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+inline std::uint64_t xxh_merge_round(std::uint64_t acc, std::uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/*
+ * Streaming state, update() may be called with pieces of any size. Only whole
+ * 32-byte stripes are consumed, the rest waits in the tail buffer.
+ */
+class fast_hash {
+    std::uint64_t v1, v2, v3, v4;
+    std::uint64_t total = 0;
+    char tail[32];
+    std::size_t tail_size = 0;
+    std::uint64_t seed;
+
+    void stripe(char const *p) {
+        v1 = xxh_round(v1, xxh_read64(p));
+        v2 = xxh_round(v2, xxh_read64(p + 8));
+        v3 = xxh_round(v3, xxh_read64(p + 16));
+        v4 = xxh_round(v4, xxh_read64(p + 24));
+    }
+
+public:
+    explicit fast_hash(std::uint64_t seed = 0) : seed(seed) {
+        v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        v2 = seed + XXH_PRIME64_2;
+        v3 = seed;
+        v4 = seed - XXH_PRIME64_1;
+    }
+
+    void update(char const *data, std::size_t len) {
+        if (len == 0) return;
+        total += len;
+        if (tail_size + len < 32) {
+            std::memcpy(tail + tail_size, data, len);
+            tail_size += len;
+            return;
+        }
+        if (tail_size > 0) {
+            std::size_t part = 32 - tail_size;
+            std::memcpy(tail + tail_size, data, part);
+            stripe(tail);
+            data += part;
+            len -= part;
+            tail_size = 0;
+        }
+        for (; len >= 32; data += 32, len -= 32) stripe(data);
+        std::memcpy(tail, data, len);
+        tail_size = len;
+    }
+
+    std::uint64_t digest() const {
+        std::uint64_t h;
+        if (total >= 32) {
+            h = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) + xxh_rotl(v4, 18);
+            h = xxh_merge_round(h, v1);
+            h = xxh_merge_round(h, v2);
+            h = xxh_merge_round(h, v3);
+            h = xxh_merge_round(h, v4);
+        } else {
+            h = seed + XXH_PRIME64_5;
+        }
+        h += total;
+        char const *p = tail;
+        std::size_t len = tail_size;
+        for (; len >= 8; p += 8, len -= 8) {
+            h ^= xxh_round(0, xxh_read64(p));
+            h = xxh_rotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        }
+        if (len >= 4) {
+            h ^= static_cast<std::uint64_t>(xxh_read32(p)) * XXH_PRIME64_1;
+            h = xxh_rotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+            p += 4;
+            len -= 4;
+        }
+        for (; len > 0; p++, len--) {
+            h ^= static_cast<std::uint8_t>(*p) * XXH_PRIME64_5;
+            h = xxh_rotl(h, 11) * XXH_PRIME64_1;
+        }
+        h ^= h >> 33;
+        h *= XXH_PRIME64_2;
+        h ^= h >> 29;
+        h *= XXH_PRIME64_3;
+        h ^= h >> 32;
+        return h;
+    }
+};
+
+inline std::uint64_t hash64(char const *data, std::size_t len, std::uint64_t seed = 0) {
+    fast_hash h(seed);
+    h.update(data, len);
+    return h.digest();
+}
+
+#endif // FAST_HASH_HPP
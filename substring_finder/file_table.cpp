@@ -0,0 +1,256 @@
+#include "file_table.h"
+
+#include <cstring>
+
+#include "fast_hash.hpp"
+
+const file_entry file_table::NONE;
+const std::uint8_t file_table::USED;
+
+namespace {
+    const std::size_t INITIAL_SLOTS = 16;
+}
+
+file_table::file_table() {
+    clear();
+}
+
+void file_table::clear() {
+    names.clear();
+    garbage = 0;
+    directories.clear();
+    parents.clear();
+    name_offsets.clear();
+    name_lengths.clear();
+    sizes.clear();
+    times.clear();
+    flag_bits.clear();
+    free_entries.clear();
+    number_of_used = 0;
+    file_slots.assign(INITIAL_SLOTS, 0);
+    directory_slots.assign(INITIAL_SLOTS, 0);
+}
+
+std::uint64_t file_table::slot_hash(std::uint32_t parent, char const *name, std::size_t length) {
+    return hash64(name, length, parent);
+}
+
+std::uint32_t file_table::store(arena &names, char const *name, std::size_t length, std::size_t &garbage) {
+    if (length == 0) {
+        /* empty names are read from the first block, which might not exist at the end of the arena */
+        if (names.empty()) {
+            names.push_back(0);
+            garbage++;
+        }
+        return 0;
+    }
+    std::size_t room = arena::BLOCK_SIZE - (names.size() & (arena::BLOCK_SIZE - 1));
+    if (length > room) {
+        names.resize(names.size() + room, 0);
+        garbage += room;
+    }
+    std::uint32_t offset = static_cast<std::uint32_t>(names.size());
+    for (std::size_t i = 0; i < length; i++) names.push_back(name[i]);
+    return offset;
+}
+
+std::uint64_t file_table::file_hash(file_entry entry) const {
+    return slot_hash(parents[entry], names.data_at(name_offsets[entry]), name_lengths[entry]);
+}
+
+std::uint64_t file_table::directory_hash(std::uint32_t dir) const {
+    const directory &d = directories[dir];
+    return slot_hash(d.parent, names.data_at(d.name), d.length);
+}
+
+void file_table::grow(shared_array<std::uint32_t> &table, bool files) {
+    shared_array<std::uint32_t> grown;
+    grown.assign(table.size() * 2, 0);
+    std::size_t mask = grown.size() - 1;
+    for (std::size_t k = 0; k < table.size(); k++) {
+        std::uint32_t slot = table[k];
+        if (slot == 0) continue;
+        std::size_t i = (files ? file_hash(slot - 1) : directory_hash(slot - 1)) & mask;
+        while (grown[i] != 0) i = (i + 1) & mask;
+        grown.set(i, slot);
+    }
+    table.swap(grown);
+}
+
+std::uint32_t file_table::find_directory(std::uint32_t parent, char const *name, std::size_t length) const {
+    std::size_t mask = directory_slots.size() - 1;
+    for (std::size_t i = slot_hash(parent, name, length) & mask; directory_slots[i] != 0; i = (i + 1) & mask) {
+        const directory &d = directories[directory_slots[i] - 1];
+        if (d.parent == parent && d.length == length && std::memcmp(names.data_at(d.name), name, length) == 0) {
+            return directory_slots[i] - 1;
+        }
+    }
+    return NONE;
+}
+
+/* the directory of the first length bytes of the path, its parents are added first */
+std::uint32_t file_table::add_directory(const std::string &path, std::size_t length) {
+    std::size_t slash = length == 0 ? std::string::npos : path.rfind('/', length - 1);
+    std::uint32_t parent = slash == std::string::npos ? NONE : add_directory(path, slash);
+    std::size_t from = slash == std::string::npos ? 0 : slash + 1;
+    std::uint32_t dir = find_directory(parent, path.data() + from, length - from);
+    if (dir != NONE) {
+        return dir;
+    }
+    if (2 * (directories.size() + 1) > directory_slots.size()) {
+        grow(directory_slots, false);
+    }
+    dir = static_cast<std::uint32_t>(directories.size());
+    directories.push_back({parent, store(names, path.data() + from, length - from, garbage),
+                           static_cast<std::uint32_t>(length - from)});
+    std::size_t mask = directory_slots.size() - 1;
+    std::size_t i = directory_hash(dir) & mask;
+    while (directory_slots[i] != 0) i = (i + 1) & mask;
+    directory_slots.set(i, dir + 1);
+    return dir;
+}
+
+std::uint32_t file_table::find_directory(const std::string &path) const {
+    if (path == "/") {
+        return find_directory(NONE, "", 0);
+    }
+    std::uint32_t parent = NONE;
+    for (std::size_t from = 0;;) {
+        std::size_t slash = path.find('/', from);
+        std::size_t length = (slash == std::string::npos ? path.size() : slash) - from;
+        parent = find_directory(parent, path.data() + from, length);
+        if (parent == NONE || slash == std::string::npos) {
+            return parent;
+        }
+        from = slash + 1;
+    }
+}
+
+file_entry file_table::find(std::uint32_t dir, const std::string &name) const {
+    std::size_t mask = file_slots.size() - 1;
+    for (std::size_t i = slot_hash(dir, name.data(), name.size()) & mask; file_slots[i] != 0; i = (i + 1) & mask) {
+        file_entry entry = file_slots[i] - 1;
+        if (parents[entry] == dir && name_lengths[entry] == name.size() &&
+                std::memcmp(names.data_at(name_offsets[entry]), name.data(), name.size()) == 0) {
+            return entry;
+        }
+    }
+    return NONE;
+}
+
+file_entry file_table::find(const std::string &path) const {
+    std::size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        return find(NONE, path);
+    }
+    std::uint32_t dir = find_directory(path.substr(0, slash));
+    return dir == NONE ? NONE : find(dir, path.substr(slash + 1));
+}
+
+file_entry file_table::add(const std::string &path) {
+    std::size_t slash = path.rfind('/');
+    std::uint32_t dir = slash == std::string::npos ? NONE : add_directory(path, slash);
+    std::size_t from = slash == std::string::npos ? 0 : slash + 1;
+    file_entry entry = find(dir, path.substr(from));
+    if (entry != NONE) {
+        return entry;
+    }
+    if (2 * (number_of_used + 1) > file_slots.size()) {
+        grow(file_slots, true);
+    }
+    if (!free_entries.empty()) {
+        entry = free_entries.back();
+        free_entries.pop_back();
+    } else {
+        entry = static_cast<file_entry>(flag_bits.size());
+        parents.push_back(0);
+        name_offsets.push_back(0);
+        name_lengths.push_back(0);
+        sizes.push_back(0);
+        times.push_back(0);
+        flag_bits.push_back(0);
+    }
+    parents.set(entry, dir);
+    name_offsets.set(entry, store(names, path.data() + from, path.size() - from, garbage));
+    name_lengths.set(entry, static_cast<std::uint16_t>(path.size() - from));
+    sizes.set(entry, 0);
+    times.set(entry, 0);
+    flag_bits.set(entry, USED);
+    number_of_used++;
+    std::size_t mask = file_slots.size() - 1;
+    std::size_t i = file_hash(entry) & mask;
+    while (file_slots[i] != 0) i = (i + 1) & mask;
+    file_slots.set(i, entry + 1);
+    return entry;
+}
+
+/* linear probing: the entries after the hole which may be moved into it are moved */
+void file_table::erase_slot(file_entry entry) {
+    std::size_t mask = file_slots.size() - 1;
+    std::size_t i = file_hash(entry) & mask;
+    while (file_slots[i] != entry + 1) i = (i + 1) & mask;
+    file_slots.set(i, 0);
+    for (std::size_t j = (i + 1) & mask; file_slots[j] != 0; j = (j + 1) & mask) {
+        std::size_t home = file_hash(file_slots[j] - 1) & mask;
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            file_slots.set(i, file_slots[j]);
+            file_slots.set(j, 0);
+            i = j;
+        }
+    }
+}
+
+void file_table::remove(file_entry entry) {
+    if (!used(entry)) {
+        return;
+    }
+    erase_slot(entry);
+    garbage += name_lengths[entry];
+    flag_bits.set(entry, 0);
+    free_entries.push_back(entry);
+    number_of_used--;
+    if (garbage > names.size() / 2 && garbage > 4096) {
+        compact_names();
+    }
+}
+
+void file_table::compact_names() {
+    arena compacted;
+    std::size_t padding = 0;
+    for (std::size_t dir = 0; dir < directories.size(); dir++) {
+        directory &d = directories.edit(dir);
+        d.name = store(compacted, names.data_at(d.name), d.length, padding);
+    }
+    for (file_entry entry = 0; entry < end(); entry++) {
+        if (!used(entry)) continue;
+        name_offsets.set(entry, store(compacted, names.data_at(name_offsets[entry]), name_lengths[entry], padding));
+    }
+    names.swap(compacted);
+    garbage = padding;
+}
+
+void file_table::append_directory(std::uint32_t dir, std::string &out) const {
+    const directory &d = directories[dir];
+    if (d.parent != NONE) {
+        append_directory(d.parent, out);
+        out.push_back('/');
+    }
+    out.append(names.data_at(d.name), d.length);
+}
+
+std::string file_table::path(file_entry entry) const {
+    std::string out;
+    if (parents[entry] != NONE) {
+        append_directory(parents[entry], out);
+        out.push_back('/');
+    }
+    out.append(names.data_at(name_offsets[entry]), name_lengths[entry]);
+    return out;
+}
+
+std::size_t file_table::memory() const {
+    return names.memory() + directories.memory() + parents.memory() + name_offsets.memory() + name_lengths.memory() +
+           sizes.memory() + times.memory() + flag_bits.memory() + free_entries.capacity() * sizeof(file_entry) +
+           file_slots.memory() + directory_slots.memory();
+}
@@ -0,0 +1,97 @@
+#ifndef FILE_TABLE_H
+#define FILE_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "shared_array.hpp"
+
+typedef std::uint32_t file_entry;
+
+/*
+ * Every known file once, under a dense id. A path is kept as its directory
+ * and its name: directories are shared by their files and subdirectories, and
+ * all names live in one arena. Metadata is kept in columns indexed by the id.
+ * Lookups go through open addressing tables of (directory, name) pairs, so no
+ * path is stored whole. Ids of removed files are reused. The arena, columns
+ * and tables are shared arrays, so a copy of the table only copies the blocks
+ * which are changed after it was taken.
+ */
+class file_table {
+public:
+    static const file_entry NONE = UINT32_MAX;
+    /* the low bit of flags tells the entry is used, the other bits belong to the owner of the table */
+    static const std::uint8_t USED = 1;
+
+private:
+    struct directory {
+        std::uint32_t parent;
+        std::uint32_t name;
+        std::uint32_t length;
+    };
+
+    /* a name never crosses a block of the arena, so it can be read in one piece */
+    typedef shared_array<char, 16> arena;
+
+    arena names;
+    /* bytes of the arena which belong to removed entries or pad the end of a block */
+    std::size_t garbage = 0;
+    shared_array<directory> directories;
+    shared_array<std::uint32_t> parents;
+    shared_array<std::uint32_t> name_offsets;
+    shared_array<std::uint16_t> name_lengths;
+    shared_array<std::int64_t> sizes;
+    shared_array<std::int64_t> times;
+    shared_array<std::uint8_t> flag_bits;
+    std::vector<file_entry> free_entries;
+    std::size_t number_of_used = 0;
+    /* 0 is an empty slot, others hold the id + 1 */
+    shared_array<std::uint32_t> file_slots;
+    shared_array<std::uint32_t> directory_slots;
+
+    static std::uint64_t slot_hash(std::uint32_t parent, char const *name, std::size_t length);
+    static std::uint32_t store(arena &names, char const *name, std::size_t length, std::size_t &garbage);
+    std::uint64_t file_hash(file_entry entry) const;
+    std::uint64_t directory_hash(std::uint32_t dir) const;
+    std::uint32_t find_directory(std::uint32_t parent, char const *name, std::size_t length) const;
+    std::uint32_t add_directory(const std::string &path, std::size_t length);
+    void grow(shared_array<std::uint32_t> &table, bool files);
+    void erase_slot(file_entry entry);
+    void compact_names();
+    void append_directory(std::uint32_t dir, std::string &out) const;
+
+public:
+    file_table();
+
+    /* the entry of a path, which is added if it is not known */
+    file_entry add(const std::string &path);
+    /* NONE if the path is not known */
+    file_entry find(const std::string &path) const;
+    /* the directory of a path without a trailing slash, or of "/"; NONE if no known file is under it */
+    std::uint32_t find_directory(const std::string &path) const;
+    /* the file of that name in a directory which was found before */
+    file_entry find(std::uint32_t dir, const std::string &name) const;
+    void remove(file_entry entry);
+    void clear();
+
+    std::string path(file_entry entry) const;
+    bool used(file_entry entry) const { return entry < flag_bits.size() && (flag_bits[entry] & USED); }
+    /* entries are below end(), some of them may be unused */
+    file_entry end() const { return static_cast<file_entry>(flag_bits.size()); }
+    std::size_t size() const { return number_of_used; }
+
+    std::int64_t size_of(file_entry entry) const { return sizes[entry]; }
+    std::int64_t modified(file_entry entry) const { return times[entry]; }
+    std::uint8_t flags(file_entry entry) const { return flag_bits[entry]; }
+    void set_metadata(file_entry entry, std::int64_t size, std::int64_t modified) {
+        sizes.set(entry, size);
+        times.set(entry, modified);
+    }
+    void set_flags(file_entry entry, std::uint8_t flags) { flag_bits.set(entry, flags | USED); }
+
+    /* bytes held by the table, to compare with a table of whole paths */
+    std::size_t memory() const;
+};
+
+#endif // FILE_TABLE_H
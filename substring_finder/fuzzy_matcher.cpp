@@ -0,0 +1,106 @@
+#include "fuzzy_matcher.h"
+
+#include <algorithm>
+
+const std::size_t fuzzy_matcher::MAX_LENGTH;
+
+fuzzy_matcher::fuzzy_matcher(const std::string &pattern, std::size_t k)
+        : length(std::min(pattern.size(), MAX_LENGTH)), k(k) {
+    std::fill(peq, peq + 256, 0);
+    std::fill(reverse_peq, reverse_peq + 256, 0);
+    for (std::size_t i = 0; i < length; i++) {
+        peq[static_cast<std::uint8_t>(pattern[i])] |= std::uint64_t(1) << i;
+        reverse_peq[static_cast<std::uint8_t>(pattern[length - 1 - i])] |= std::uint64_t(1) << i;
+    }
+}
+
+/*
+ * The reversed pattern is aligned to the text read backwards from end, this
+ * time anchored at end; the start is where its distance is the smallest.
+ * Starts before lower are not taken, so the distance may be above k.
+ */
+std::uint64_t fuzzy_matcher::find_start(char const *data, std::uint64_t end, std::uint64_t lower,
+                                        std::size_t &distance) const {
+    std::uint64_t high = std::uint64_t(1) << (length - 1);
+    std::uint64_t pv = ~std::uint64_t(0), mv = 0;
+    std::size_t score = length, best = length;
+    std::uint64_t start = end;
+    std::uint64_t limit = end - std::min<std::uint64_t>(end - lower, length + k);
+    for (std::uint64_t i = end; i > limit; i--) {
+        std::uint64_t eq = reverse_peq[static_cast<std::uint8_t>(data[i - 1])];
+        std::uint64_t xv = eq | mv;
+        std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        std::uint64_t ph = mv | ~(xh | pv);
+        std::uint64_t mh = pv & xh;
+        if (ph & high) {
+            score++;
+        } else if (mh & high) {
+            score--;
+        }
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        if (score < best) {
+            best = score;
+            start = i - 1;
+        }
+    }
+    distance = best;
+    return start;
+}
+
+void fuzzy_matcher::find_all(char const *data, std::size_t size, std::uint64_t begin, std::uint64_t end,
+                             std::uint64_t &from,
+                             const std::function<bool(std::uint64_t, std::uint64_t, std::size_t)> &on_match) const {
+    if (length == 0) {
+        return;
+    }
+    std::uint64_t high = std::uint64_t(1) << (length - 1);
+    std::uint64_t pv = ~std::uint64_t(0), mv = 0;
+    std::size_t score = length;
+    bool in_run = false;
+    std::size_t best = 0;
+    std::uint64_t best_end = 0;
+    auto report = [&]() {
+        std::size_t distance;
+        std::uint64_t start = find_start(data, best_end, std::max(begin, from), distance);
+        if (start >= end || start < from || distance > k) {
+            return true;
+        }
+        from = best_end;
+        return on_match(start, best_end - start, distance);
+    };
+    std::uint64_t limit = std::min<std::uint64_t>(size, end + length + k);
+    for (std::uint64_t i = begin; i < limit; i++) {
+        std::uint64_t eq = peq[static_cast<std::uint8_t>(data[i])];
+        std::uint64_t xv = eq | mv;
+        std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        std::uint64_t ph = mv | ~(xh | pv);
+        std::uint64_t mh = pv & xh;
+        if (ph & high) {
+            score++;
+        } else if (mh & high) {
+            score--;
+        }
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        if (score <= k) {
+            if (!in_run || score < best) {
+                best = score;
+                best_end = i + 1;
+            }
+            in_run = true;
+        } else if (in_run) {
+            in_run = false;
+            if (!report()) {
+                return;
+            }
+        }
+    }
+    if (in_run) {
+        report();
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef FUZZY_MATCHER_H
+#define FUZZY_MATCHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/*
+ * Approximate matching with Myers' bit-parallel algorithm: finds substrings
+ * within k edits (insertions, deletions and substitutions of bytes) of a
+ * pattern of at most MAX_LENGTH bytes. Shared by the verifying threads.
+ */
+class fuzzy_matcher {
+    std::size_t length;
+    std::size_t k;
+    std::uint64_t peq[256];
+    std::uint64_t reverse_peq[256];
+
+    std::uint64_t find_start(char const *data, std::uint64_t end, std::uint64_t lower, std::size_t &distance) const;
+
+public:
+    static const std::size_t MAX_LENGTH = 64;
+
+    fuzzy_matcher(const std::string &pattern, std::size_t k);
+
+    /*
+     * Calls on_match(offset, length, distance) for the best match of every run
+     * of matching ends, if it starts in [begin, end) and not before from.
+     * Matches do not overlap, from is moved past every one reported.
+     */
+    void find_all(char const *data, std::size_t size, std::uint64_t begin, std::uint64_t end, std::uint64_t &from,
+                  const std::function<bool(std::uint64_t, std::uint64_t, std::size_t)> &on_match) const;
+};
+
+#endif // FUZZY_MATCHER_H
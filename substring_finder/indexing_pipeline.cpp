@@ -0,0 +1,137 @@
+#include "indexing_pipeline.h"
+#include "text_detector.h"
+#include "fast_hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+indexing_pipeline::indexing_pipeline(extractor extract, size_t io_threads, size_t cpu_threads,
+                                     cancellation_token *token, size_t capacity)
+        : extract(std::move(extract)), jobs(capacity), opened(capacity), results(capacity),
+          active_readers(0), active_extractors(0), token(token) {
+    io_threads = std::max<size_t>(1, io_threads);
+    cpu_threads = std::max<size_t>(1, cpu_threads);
+    active_readers = io_threads;
+    active_extractors = cpu_threads;
+    for (size_t i = 0; i < io_threads; i++) {
+        threads.emplace_back(&indexing_pipeline::read_loop, this);
+    }
+    for (size_t i = 0; i < cpu_threads; i++) {
+        threads.emplace_back(&indexing_pipeline::extract_loop, this);
+    }
+}
+
+indexing_pipeline::~indexing_pipeline() {
+    jobs.close();
+    opened.close();
+    results.close();
+    for (std::thread &t : threads) t.join();
+}
+
+void indexing_pipeline::submit(index_job job) {
+    jobs.push(std::move(job));
+}
+
+void indexing_pipeline::close() {
+    jobs.close();
+}
+
+bool indexing_pipeline::next(index_result &result) {
+    for (;;) {
+        if (!released.empty()) {
+            result = std::move(released.back());
+            released.pop_back();
+            return true;
+        }
+        if (!results.pop(result)) return false;
+        content_key content = {result.fingerprint.size, result.content};
+        if (result.copy) {
+            auto it = delivered.find(content);
+            if (it == delivered.end()) {
+                waiting.emplace(content, std::move(result));
+                continue;
+            }
+            result.indexed = it->second;
+            return true;
+        }
+        if (result.content != 0) {
+            delivered[content] = result.indexed;
+            auto range = waiting.equal_range(content);
+            for (auto it = range.first; it != range.second; ++it) {
+                it->second.indexed = result.indexed;
+                released.push_back(std::move(it->second));
+            }
+            waiting.erase(range.first, range.second);
+        }
+        return true;
+    }
+}
+
+bool indexing_pipeline::claim(const content_key &content, const std::string &path, std::string &first) {
+    std::lock_guard<std::mutex> guard(claims_lock);
+    auto inserted = claimed.emplace(content, path);
+    if (!inserted.second) first = inserted.first->second;
+    return inserted.second;
+}
+
+/* a file which changed since it was hashed differs as well */
+static bool same_bytes(const mapped_file &file, const std::string &path) {
+    mapped_file other(path);
+    return other.is_open() && other.size() == file.size() &&
+           std::memcmp(other.data(), file.data(), file.size()) == 0;
+}
+
+bool indexing_pipeline::proceed() {
+    if (token == nullptr || token->checkpoint()) return true;
+    jobs.close();
+    opened.close();
+    results.close();
+    return false;
+}
+
+void indexing_pipeline::read_loop() {
+    index_job job;
+    while (proceed() && jobs.pop(job)) {
+        if (text_detector::binary_extension(job.path)) {
+            results.push({std::move(job.path), job.fingerprint, false, {}, 0, false});
+            continue;
+        }
+        std::unique_ptr<mapped_file> file(new mapped_file(job.path));
+        /* only the first page is touched before a binary file is rejected */
+        if (file->is_open() && text_detector::binary_header(file->data(), file->size())) {
+            results.push({std::move(job.path), job.fingerprint, false, {}, 0, false});
+            continue;
+        }
+        file->will_need();
+        opened.push({std::move(job), std::move(file)});
+    }
+    if (--active_readers == 0) opened.close();
+}
+
+void indexing_pipeline::extract_loop() {
+    trigram_set trigrams;
+    opened_file item;
+    while (proceed() && opened.pop(item)) {
+        index_result result = {std::move(item.job.path), item.job.fingerprint, false, {}, 0, false};
+        if (item.file->is_open()) {
+            std::uint64_t hash = hash64(item.file->data(), item.file->size());
+            std::string first;
+            /* the writer keys copies by the size in the fingerprint, a file which changed since is not shared */
+            bool shared = static_cast<std::int64_t>(item.file->size()) == result.fingerprint.size;
+            content_key content = {result.fingerprint.size, hash};
+            if (shared && !claim(content, result.path, first) && same_bytes(*item.file, first)) {
+                result.content = hash;
+                result.copy = true;
+            } else {
+                result.content = shared && first.empty() ? hash : 0;
+                result.indexed = extract(*item.file, trigrams, result.chunks);
+                if (!result.indexed) result.chunks.clear();
+            }
+        }
+        item.file.reset();
+        trigrams.clear();
+        if (!proceed()) break;
+        results.push(std::move(result));
+    }
+    if (--active_extractors == 0) results.close();
+}
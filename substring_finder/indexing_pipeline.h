@@ -0,0 +1,95 @@
+#ifndef INDEXING_PIPELINE_H
+#define INDEXING_PIPELINE_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "cancellation.hpp"
+#include "mapped_file.h"
+#include "trigram_index.h"
+#include "trigrams.hpp"
+
+struct index_job {
+    std::string path;
+    file_fingerprint fingerprint;
+};
+
+struct index_result {
+    std::string path;
+    file_fingerprint fingerprint;
+    /* false if the file could not be indexed */
+    bool indexed;
+    std::vector<chunk_trigrams> chunks;
+    /* XXH64 of the content, 0 if the file was not read or it must not be shared */
+    std::uint64_t content;
+    /* an earlier file has the same bytes, the chunks are left empty */
+    bool copy;
+};
+
+/*
+ * submit -> I/O threads (open, sniff, map, prefetch) -> CPU threads (extract
+ * trigrams into a per-thread set) -> results, which are taken by a single
+ * writer. Every stage is connected by a bounded queue, so a slow stage
+ * blocks the previous one instead of piling up mapped files or trigram sets.
+ * Once the token is canceled all queues are closed and files which were not
+ * finished are dropped, so the writer never sees a partial result.
+ * Only the first file with some content is extracted, the hash is taken while
+ * the file is mapped anyway. Later files with the same size and hash are
+ * compared with it byte by byte; if they are equal they come out as copies,
+ * after the first one, so the writer can add them to it.
+ */
+class indexing_pipeline {
+public:
+    /* fills the chunks of a file, the set is a scratch space which is reused for every file */
+    typedef std::function<bool(const mapped_file &, trigram_set &, std::vector<chunk_trigrams> &)> extractor;
+
+private:
+    struct opened_file {
+        index_job job;
+        std::unique_ptr<mapped_file> file;
+    };
+
+    extractor extract;
+    bounded_queue<index_job> jobs;
+    bounded_queue<opened_file> opened;
+    bounded_queue<index_result> results;
+    std::atomic<size_t> active_readers;
+    std::atomic<size_t> active_extractors;
+    std::vector<std::thread> threads;
+    cancellation_token *token;
+    std::mutex claims_lock;
+    /* contents which are extracted by some thread -> path of the file */
+    std::unordered_map<content_key, std::string, content_key_hash> claimed;
+    /* used by the writer only: content -> whether its first file was indexed */
+    std::unordered_map<content_key, bool, content_key_hash> delivered;
+    /* copies which came out before the first file with their content */
+    std::unordered_multimap<content_key, index_result, content_key_hash> waiting;
+    std::vector<index_result> released;
+
+    bool proceed();
+    /* true if the content was not claimed yet, the path of the file which did otherwise */
+    bool claim(const content_key &content, const std::string &path, std::string &first);
+    void read_loop();
+    void extract_loop();
+
+public:
+    indexing_pipeline(extractor extract, size_t io_threads, size_t cpu_threads,
+                      cancellation_token *token = nullptr, size_t capacity = 256);
+    ~indexing_pipeline();
+
+    /* blocks while the pipeline is full */
+    void submit(index_job job);
+    /* no more jobs will be submitted */
+    void close();
+    /* blocks until the next file is done; false when everything submitted is done */
+    bool next(index_result &result);
+};
+
+#endif // INDEXING_PIPELINE_H
@@ -18,6 +18,7 @@
 #include <future>
 
 const size_t COLUMNS = 5;
+const size_t MAX_RESULTS = 10000;
 
 main_window::main_window(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow) {
     ui->setupUi(this);
@@ -29,6 +30,8 @@ main_window::main_window(QWidget *parent) : QMainWindow(parent), ui(new Ui::Main
     ui->actionExit->setIcon(style.standardIcon(QCommonStyle::SP_DialogCloseButton));
     ui->actionRefresh->setIcon(style.standardIcon(QCommonStyle::SP_BrowserReload));
     ui->actionScan->setIcon(style.standardIcon(QCommonStyle::SP_MediaPlay));
+    ui->actionPause->setIcon(style.standardIcon(QCommonStyle::SP_MediaPause));
+    ui->actionCancel->setIcon(style.standardIcon(QCommonStyle::SP_MediaStop));
 
     ui->treeWidget->header()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
     ui->treeWidget->header()->setSectionResizeMode(0, QHeaderView::Interactive);
@@ -41,12 +44,38 @@ main_window::main_window(QWidget *parent) : QMainWindow(parent), ui(new Ui::Main
     connect(ui->actionAbout, &QAction::triggered, this, &main_window::about_slot);
     connect(ui->actionAgain, &QAction::triggered, this, &main_window::again_slot);
     connect(ui->actionFindSubstring, &QAction::triggered, this, &main_window::find_substring_slot);
+    connect(ui->actionFindSubstrings, &QAction::triggered, this, &main_window::find_substrings_slot);
     connect(ui->actionExit, &QAction::triggered, this, &main_window::exit_slot);
     connect(ui->actionRefresh, &QAction::triggered, this, &main_window::refresh_slot);
     connect(ui->actionScan, &QAction::triggered, this, &main_window::scan_slot);
     connect(ui->actionBack, &QAction::triggered, this, &main_window::back_slot);
+    connect(ui->actionPause, &QAction::triggered, this, &main_window::pause_slot);
+    connect(ui->actionCancel, &QAction::triggered, this, &main_window::cancel_slot);
     connect(ui->treeWidget, &QTreeWidget::itemActivated, this, &main_window::open_slot);
 
+    search_box = new QLineEdit(this);
+    search_box->setPlaceholderText("Search as you type");
+    search_box->setClearButtonEnabled(true);
+    search_box->setMaximumWidth(300);
+    search_action = ui->toolBar->addWidget(search_box);
+    search_action->setVisible(false);
+    connect(search_box, &QLineEdit::textEdited, this, &main_window::search_edited_slot);
+    edits_box = new QSpinBox(this);
+    edits_box->setRange(0, 8);
+    edits_box->setPrefix("edits: ");
+    edits_box->setToolTip("Find matches within this many inserted, deleted or replaced bytes");
+    edits_action = ui->toolBar->addWidget(edits_box);
+    edits_action->setVisible(false);
+    budget_box = new QSpinBox(this);
+    budget_box->setRange(0, 1024 * 1024);
+    budget_box->setSingleStep(256);
+    budget_box->setValue(1024);
+    budget_box->setPrefix("index memory: ");
+    budget_box->setSuffix(" MiB");
+    budget_box->setSpecialValueText("index memory: no limit");
+    budget_box->setToolTip("Posting lists over this size are spilled to disk while indexing");
+    ui->toolBar->addWidget(budget_box);
+
     thread = new QThread();
     st.moveToThread(thread);
     connect(thread, &QThread::started, &st, &scantools::start);
@@ -71,13 +100,21 @@ void main_window::about_slot() {
 }
 
 void main_window::again_slot() {
-    st.end();
+    /* the index and the watcher belong to the scanning thread, which may be applying changes */
+    if (thread->isRunning()) {
+        QMetaObject::invokeMethod(&st, "end", Qt::BlockingQueuedConnection);
+    } else {
+        st.end();
+    }
     thread->quit();
+    thread->wait();
     if (ui->actionBack->isEnabled()) {
         connect(ui->treeWidget, &QTreeWidget::itemActivated, this, &main_window::open_slot);
     }
     setItemsEnabled(true, ui->actionChoose, ui->actionRefresh, ui->actionScan);
-    setItemsVisible(false, ui->actionAgain, ui->actionFindSubstring, ui->actionBack);
+    setItemsVisible(false, ui->actionAgain, ui->actionFindSubstring, ui->actionFindSubstrings, ui->actionBack,
+                    search_action, edits_action);
+    search_box->clear();
     ui->actionFindSubstring->setText("Find substring");
     ui->treeWidget->setEnabled(false);
     st.open_directory();
@@ -93,6 +130,10 @@ void main_window::back_slot() {
     st.open_directory();
 }
 
+void main_window::cancel_slot() {
+    st.cancel();
+}
+
 void main_window::choose_slot() {
     QString dir = QFileDialog::getExistingDirectory(this, "Select Directory for Scanning",
                 QString(), QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
@@ -103,17 +144,78 @@ void main_window::choose_slot() {
 void main_window::find_substring_slot() {
     auto gh = input_dialog();
     disconnect(ui->treeWidget, &QTreeWidget::itemActivated, this, &main_window::open_slot);
-    if (gh.first) st.find_substring(gh.second);
+    if (gh.first) {
+        search(gh.second);
+    }
     setItemsEnabled(true, ui->actionBack);
     setHeaderSpecialText(ui->treeWidget);
     ui->actionFindSubstring->setText("Find another substring");
 }
 
+void main_window::find_substrings_slot() {
+    bool ok;
+    QString text = QInputDialog::getMultiLineText(this, "Find substrings", "One pattern per line:", "", &ok);
+    if (!ok || searching) {
+        return;
+    }
+    disconnect(ui->treeWidget, &QTreeWidget::itemActivated, this, &main_window::open_slot);
+    setItemsEnabled(true, ui->actionBack);
+    setHeaderSpecialText(ui->treeWidget);
+    searching = true;
+    setItemsVisible(true, ui->actionCancel);
+    st.find_substrings(text.split('\n', QString::SkipEmptyParts), MAX_RESULTS);
+    setItemsVisible(false, ui->actionCancel);
+    searching = false;
+}
+
+void main_window::search_edited_slot(const QString &text) {
+    if (text.isEmpty()) {
+        st.cancel();
+        if (ui->actionBack->isEnabled()) back_slot();
+        return;
+    }
+    disconnect(ui->treeWidget, &QTreeWidget::itemActivated, this, &main_window::open_slot);
+    setItemsEnabled(true, ui->actionBack);
+    setHeaderSpecialText(ui->treeWidget);
+    search(text);
+}
+
+/* a query typed during a search cancels it, the latest one is searched when it returns */
+void main_window::search(const QString &query) {
+    pending_query = query;
+    if (searching) {
+        st.cancel();
+        return;
+    }
+    searching = true;
+    setItemsVisible(true, ui->actionCancel);
+    QString current;
+    do {
+        current = pending_query;
+        if (ui->actionRegex->isChecked()) {
+            st.find_regex(current, MAX_RESULTS, ui->actionIgnoreCase->isChecked());
+        } else if (edits_box->value() > 0) {
+            st.find_fuzzy(current, edits_box->value(), MAX_RESULTS);
+        } else {
+            st.find_substring(current, MAX_RESULTS, ui->actionIgnoreCase->isChecked());
+        }
+    } while (current != pending_query);
+    setItemsVisible(false, ui->actionCancel);
+    searching = false;
+}
+
 void main_window::exit_slot() {
     if (st.is_scanning() || st.is_paused()) {
         auto res = long_dialog("Exit", "Do you really want to exit? Files are still scanning");
         if (res == QMessageBox::Ok) {
-            thread->terminate();
+            /* the thread must leave start() before its event loop can be quit */
+            st.cancel();
+            while (st.is_scanning() || st.is_paused()) {
+                QCoreApplication::processEvents();
+                QThread::msleep(10);
+            }
+            thread->quit();
+            thread->wait();
             QWidget::close();
         }
     } else {
@@ -128,11 +230,23 @@ void main_window::open_slot(QTreeWidgetItem *item, int column) {
     st.open_directory(path);
 }
 
+void main_window::pause_slot() {
+    if (st.is_paused()) {
+        st.resume();
+        setText(ui->actionPause, "Pause");
+    } else if (st.is_scanning()) {
+        st.pause();
+        setText(ui->actionPause, "Resume");
+    }
+}
+
 void main_window::refresh_slot() {
     st.open_directory();
 }
 
 void main_window::scan_slot() {
+    st.set_case_folding(ui->actionIgnoreCase->isChecked());
+    st.set_memory_budget(budget_box->value());
     thread->start();
     ui->treeWidget->clear();
 }
@@ -140,11 +254,15 @@ void main_window::scan_slot() {
 void main_window::started_slot() {
     setText(ui->actionScan, "Resume");
     setItemsEnabled(false, ui->actionChoose, ui->actionRefresh, ui->actionScan);
+    setItemsVisible(true, ui->actionPause, ui->actionCancel);
     ui->treeWidget->setDisabled(true);
 }
 void main_window::finished_slot() {
     setText(ui->actionScan, "Scan");
-    setItemsVisible(true, ui->actionAgain, ui->actionFindSubstring, ui->actionBack);
+    setText(ui->actionPause, "Pause");
+    setItemsVisible(false, ui->actionPause, ui->actionCancel);
+    setItemsVisible(true, ui->actionAgain, ui->actionFindSubstring, ui->actionFindSubstrings, ui->actionBack,
+                    search_action, edits_action);
     setItemsEnabled(false, ui->actionScan, ui->actionBack);
     ui->treeWidget->setEnabled(true);
 }
@@ -8,6 +8,8 @@
 #include <QTreeWidgetItem>
 #include <QBrush>
 #include <QAction>
+#include <QLineEdit>
+#include <QSpinBox>
 #include <memory>
 #include <queue>
 
@@ -56,12 +58,16 @@ private slots:
     void about_slot();
     void again_slot();
     void back_slot();
+    void cancel_slot();
     void choose_slot();
     void find_substring_slot();
+    void find_substrings_slot();
     void exit_slot();
     void open_slot(QTreeWidgetItem *item, int column);
+    void pause_slot();
     void refresh_slot();
     void scan_slot();
+    void search_edited_slot(const QString &text);
 
     void error(QString &text);
 
@@ -80,6 +86,18 @@ private:
     scantools st;
     console cs;
     bool scanning = false;
+    QLineEdit *search_box;
+    QAction *search_action;
+    /* edits allowed by search as you type, 0 for exact search */
+    QSpinBox *edits_box;
+    QAction *edits_action;
+    /* megabytes of posting lists kept in memory while indexing, 0 for no limit */
+    QSpinBox *budget_box;
+    /* a search runs the event loop, so typing may arrive while it is not finished */
+    bool searching = false;
+    QString pending_query;
+
+    void search(const QString &query);
 
     int short_dialog(QString const &text);
     int long_dialog(QString const &text, QString const &information);
@@ -105,10 +123,10 @@ private:
 
     void setHeaderSpecialText(QTreeWidget *treeWidget) {
         treeWidget->headerItem()->setText(0, "Path");
-        treeWidget->headerItem()->setText(1, "Position");
-        treeWidget->headerItem()->setText(2, "");
-        treeWidget->headerItem()->setText(3, "");
-        treeWidget->headerItem()->setText(4, "");
+        treeWidget->headerItem()->setText(1, "Line");
+        treeWidget->headerItem()->setText(2, "Column");
+        treeWidget->headerItem()->setText(3, "Offset");
+        treeWidget->headerItem()->setText(4, "Context");
     }
 
     void setHeaderDefaultText(QTreeWidget *treeWidget) {
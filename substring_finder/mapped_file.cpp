@@ -0,0 +1,173 @@
+#include "mapped_file.h"
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILE_POSIX
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+const std::size_t MAPPED_FILE_BUFFER_LIMIT = 256 * 1024 * 1024;
+const std::size_t READ_SIZE = 64 * 1024;
+
+#ifdef MAPPED_FILE_POSIX
+/* files mapped at the same time: the indexing queues, searches and segments */
+const std::size_t MAPPED_FILE_SLOTS = 4096;
+
+namespace {
+    std::size_t page_size;
+
+    /*
+     * Address ranges of the live mappings, read by the signal handler. A slot
+     * is free while its begin is 0; end is published after begin and cleared
+     * before it, so the handler never sees a range which is half written.
+     */
+    struct mapped_range {
+        std::atomic<std::uintptr_t> begin;
+        std::atomic<std::uintptr_t> end;
+    };
+
+    mapped_range mapped_ranges[MAPPED_FILE_SLOTS];
+    std::atomic<std::size_t> next_slot(0);
+
+    /* slot of the new range, MAPPED_FILE_SLOTS if all are taken */
+    std::size_t register_range(char const *data, std::size_t length) {
+        std::uintptr_t first = reinterpret_cast<std::uintptr_t>(data);
+        std::size_t start = next_slot.fetch_add(1, std::memory_order_relaxed);
+        for (std::size_t i = 0; i < MAPPED_FILE_SLOTS; i++) {
+            std::size_t slot = (start + i) % MAPPED_FILE_SLOTS;
+            std::uintptr_t expected = 0;
+            if (mapped_ranges[slot].begin.compare_exchange_strong(expected, first)) {
+                mapped_ranges[slot].end.store(first + length);
+                return slot;
+            }
+        }
+        return MAPPED_FILE_SLOTS;
+    }
+
+    void unregister_range(std::size_t slot) {
+        mapped_ranges[slot].end.store(0);
+        mapped_ranges[slot].begin.store(0);
+    }
+
+    bool in_mapped_range(std::uintptr_t address) {
+        for (mapped_range &range : mapped_ranges) {
+            std::uintptr_t first = range.begin.load();
+            if (first != 0 && first <= address && address < range.end.load()) return true;
+        }
+        return false;
+    }
+
+    /*
+     * Touching a page past the end of a file which was truncated under its
+     * mapping raises SIGBUS. If the page belongs to a mapped_file it is
+     * replaced by an anonymous one, so the read goes on over zeros; the
+     * watcher sees the change and reindexes the file. Jumping out of the
+     * handler instead would skip destructors and leave locks of the reader
+     * held. Bus errors anywhere else get the default action.
+     */
+    void on_bus_error(int signal, siginfo_t *info, void *) {
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(info->si_addr);
+        if (info->si_code == BUS_ADRERR && in_mapped_range(address)) {
+            std::uintptr_t page = address & ~(page_size - 1);
+            void *p = ::mmap(reinterpret_cast<void *>(page), page_size, PROT_READ,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+            if (p != MAP_FAILED) return;
+        }
+        struct sigaction fallback = {};
+        fallback.sa_handler = SIG_DFL;
+        ::sigaction(signal, &fallback, nullptr);
+        ::raise(signal);
+    }
+
+    bool install_bus_handler() {
+        page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        struct sigaction action = {};
+        action.sa_sigaction = on_bus_error;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        return ::sigaction(SIGBUS, &action, nullptr) == 0;
+    }
+}
+
+mapped_file::mapped_file(const std::string &path) {
+    static const bool guarded = install_bus_handler();
+    (void) guarded;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;
+    opened = true;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        length = static_cast<std::size_t>(st.st_size);
+        if (length == 0) {
+            ::close(fd);
+            return;
+        }
+        void *p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            /* an unguarded mapping could kill the process, so it is read instead */
+            slot = register_range(static_cast<char const *>(p), length);
+            if (slot < MAPPED_FILE_SLOTS) {
+                ::madvise(p, length, MADV_SEQUENTIAL);
+                begin = static_cast<char const *>(p);
+                mapped = true;
+                ::close(fd);
+                return;
+            }
+            ::munmap(p, length);
+        }
+        length = 0;
+    }
+    while (buffer.size() < MAPPED_FILE_BUFFER_LIMIT) {
+        std::size_t old_size = buffer.size();
+        buffer.resize(old_size + READ_SIZE);
+        ssize_t count_read = ::read(fd, &buffer[old_size], READ_SIZE);
+        if (count_read < 0) {
+            opened = false;
+            count_read = 0;
+        }
+        buffer.resize(old_size + count_read);
+        if (count_read == 0) break;
+    }
+    ::close(fd);
+    begin = buffer.data();
+    length = buffer.size();
+}
+
+mapped_file::~mapped_file() {
+    if (!mapped) return;
+    unregister_range(slot);
+    ::munmap(const_cast<char *>(begin), length);
+}
+
+void mapped_file::will_need() const {
+    if (mapped) ::madvise(const_cast<char *>(begin), length, MADV_WILLNEED);
+}
+#else
+mapped_file::mapped_file(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return;
+    opened = true;
+    while (in && buffer.size() < MAPPED_FILE_BUFFER_LIMIT) {
+        std::size_t old_size = buffer.size();
+        buffer.resize(old_size + READ_SIZE);
+        in.read(&buffer[old_size], READ_SIZE);
+        buffer.resize(old_size + static_cast<std::size_t>(in.gcount()));
+    }
+    begin = buffer.data();
+    length = buffer.size();
+}
+
+mapped_file::~mapped_file() {
+}
+
+void mapped_file::will_need() const {
+}
+#endif
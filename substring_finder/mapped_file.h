@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * Whole content of a file in memory. Regular files are mapped read-only with
+ * sequential read-ahead, everything else (pipes, devices, failed mappings) is
+ * read into a buffer of at most MAPPED_FILE_BUFFER_LIMIT bytes. Files may be
+ * changed while they are mapped: if one is truncated, the pages past its new
+ * end read as zeros instead of raising SIGBUS. The mappings are registered in
+ * a fixed table for the signal handler; when it is full files are read.
+ */
+class mapped_file {
+    char const *begin = nullptr;
+    std::size_t length = 0;
+    bool mapped = false;
+    bool opened = false;
+    std::size_t slot = 0;
+    std::vector<char> buffer;
+
+public:
+    explicit mapped_file(const std::string &path);
+    ~mapped_file();
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    /* asks the kernel to start reading the mapping ahead of use */
+    void will_need() const;
+
+    bool is_open() const { return opened; }
+    bool is_mapped() const { return mapped; }
+    char const *data() const { return begin; }
+    std::size_t size() const { return length; }
+};
+
+#endif // MAPPED_FILE_H
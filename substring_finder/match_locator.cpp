@@ -0,0 +1,42 @@
+#include "match_locator.h"
+#include "utf8.hpp"
+
+#include <algorithm>
+
+const std::size_t match_locator::SNIPPET_CONTEXT;
+
+match_locator::match_locator(char const *data, std::size_t size, std::uint64_t start, std::uint64_t number_of_lines,
+                             std::uint64_t characters)
+        : data(data), size(size), position(std::min<std::uint64_t>(start, size)), line(number_of_lines + 1),
+          column(characters + 1) {
+}
+
+void match_locator::advance(std::uint64_t offset) {
+    char const *begin = data + position;
+    char const *end = data + offset;
+    std::uint64_t newlines = std::count(begin, end, '\n');
+    if (newlines == 0) {
+        column += count_characters(begin, end);
+    } else {
+        line += newlines;
+        char const *line_start = end;
+        while (line_start[-1] != '\n') line_start--;
+        column = count_characters(line_start, end) + 1;
+    }
+    position = offset;
+}
+
+search_match match_locator::locate(const std::string &path, std::uint64_t offset, std::uint64_t length) {
+    offset = std::min<std::uint64_t>(offset, size);
+    length = std::min<std::uint64_t>(length, size - offset);
+    advance(offset);
+
+    std::uint64_t begin = offset;
+    while (begin > 0 && offset - begin < SNIPPET_CONTEXT && data[begin - 1] != '\n') begin--;
+    while (begin < offset && is_continuation(data[begin])) begin++;
+    std::uint64_t end = offset + length;
+    while (end < size && end - offset - length < SNIPPET_CONTEXT && data[end] != '\n' && data[end] != '\r') end++;
+    while (end > offset + length && end < size && is_continuation(data[end])) end--;
+
+    return {path, offset, length, line, column, std::string(data + begin, end - begin)};
+}
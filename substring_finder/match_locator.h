@@ -0,0 +1,44 @@
+#ifndef MATCH_LOCATOR_H
+#define MATCH_LOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct search_match {
+    std::string path;
+    std::uint64_t offset;
+    std::uint64_t length;
+    /* both start from 1, the column is counted in UTF-8 characters */
+    std::uint64_t line;
+    std::uint64_t column;
+    /* the match with at most SNIPPET_CONTEXT bytes of its line around it */
+    std::string snippet;
+};
+
+/*
+ * Turns byte offsets of matches in one file into lines, columns and snippets.
+ * Offsets must not decrease, newlines are counted only once from the position
+ * the locator starts at, whose line and column are given.
+ */
+class match_locator {
+    char const *data;
+    std::size_t size;
+    std::uint64_t position;
+    /* of position */
+    std::uint64_t line;
+    std::uint64_t column;
+
+    void advance(std::uint64_t offset);
+
+public:
+    static const std::size_t SNIPPET_CONTEXT = 40;
+
+    /* number_of_lines is the number of newlines before start, characters the ones between its line start and start */
+    match_locator(char const *data, std::size_t size, std::uint64_t start = 0, std::uint64_t number_of_lines = 0,
+                  std::uint64_t characters = 0);
+
+    search_match locate(const std::string &path, std::uint64_t offset, std::uint64_t length);
+};
+
+#endif // MATCH_LOCATOR_H
@@ -0,0 +1,39 @@
+#include "query_cache.h"
+
+#include <algorithm>
+
+cached_query::cached_query(std::string pattern, bool folded, const trigram_index &index, file_id horizon,
+                           std::vector<search_match> matches)
+        : pattern(std::move(pattern)), folded(folded), layout(index.layout_version()), horizon(horizon),
+          matches(std::move(matches)) {
+    for (const search_match &match : this->matches) {
+        matched_files.insert(index.entry(match.path));
+    }
+}
+
+const cached_query *query_cache::find(const std::string &pattern, bool folded, std::uint64_t layout) {
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [layout](const cached_query &query) {
+        return query.layout != layout;
+    }), entries.end());
+    const cached_query *best = nullptr;
+    for (const cached_query &query : entries) {
+        if (query.folded != folded) continue;
+        if (query.pattern == pattern) return &query;
+        if ((best == nullptr || query.pattern.size() > best->pattern.size()) &&
+                pattern.find(query.pattern) != std::string::npos) {
+            best = &query;
+        }
+    }
+    return best;
+}
+
+void query_cache::put(cached_query query) {
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->pattern == query.pattern && it->folded == query.folded) {
+            entries.erase(it);
+            break;
+        }
+    }
+    entries.push_front(std::move(query));
+    if (entries.size() > capacity) entries.pop_back();
+}
@@ -0,0 +1,47 @@
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "match_locator.h"
+#include "trigram_index.h"
+
+/*
+ * Result of a finished search. Ids of the index only grow and a changed file
+ * gets new ones, so a file whose first id is below horizon has not changed
+ * since the search; layout tells whether ids were renumbered meanwhile.
+ */
+struct cached_query {
+    std::string pattern;
+    /* the pattern is case folded and was searched in folded text */
+    bool folded;
+    std::uint64_t layout;
+    file_id horizon;
+    std::vector<search_match> matches;
+    /* entries of the index stay the same until its layout changes */
+    std::unordered_set<file_entry> matched_files;
+
+    /* the search was made over this index */
+    cached_query(std::string pattern, bool folded, const trigram_index &index, file_id horizon,
+                 std::vector<search_match> matches);
+};
+
+/* most recently used complete searches, used to answer a query which extends one of them */
+class query_cache {
+    std::deque<cached_query> entries;
+    std::size_t capacity;
+
+public:
+    explicit query_cache(std::size_t capacity = 16) : capacity(capacity) {}
+
+    /* the same pattern if it is cached, otherwise the longest cached pattern of the same mode contained in this one */
+    const cached_query *find(const std::string &pattern, bool folded, std::uint64_t layout);
+    void put(cached_query query);
+    void clear() { entries.clear(); }
+};
+
+#endif // QUERY_CACHE_H
@@ -0,0 +1,311 @@
+#include "regex_matcher.h"
+#include "utf8.hpp"
+
+#include <algorithm>
+
+const std::size_t regex_program::MAX_INSTRUCTIONS;
+const int regex_matcher::END;
+const int regex_matcher::SYMBOLS;
+const std::size_t regex_matcher::MAX_STATES;
+
+namespace {
+    typedef std::vector<std::pair<std::uint8_t, std::uint8_t>> byte_sequence;
+
+    /* byte ranges matching the UTF-8 encodings of the code points lo..hi, surrogates excluded */
+    void utf8_sequences(std::uint32_t lo, std::uint32_t hi, std::vector<byte_sequence> &out) {
+        if (lo <= 0xdfff && hi >= 0xd800) {
+            if (lo < 0xd800) utf8_sequences(lo, 0xd7ff, out);
+            if (hi > 0xdfff) utf8_sequences(0xe000, hi, out);
+            return;
+        }
+        for (std::uint32_t limit : {0x7fu, 0x7ffu, 0xffffu}) {
+            if (lo <= limit && hi > limit) {
+                utf8_sequences(lo, limit, out);
+                utf8_sequences(limit + 1, hi, out);
+                return;
+            }
+        }
+        for (int i = 1; i < 4; i++) {
+            std::uint32_t m = (1u << (6 * i)) - 1;
+            if ((lo & ~m) != (hi & ~m)) {
+                if ((lo & m) != 0) {
+                    utf8_sequences(lo, lo | m, out);
+                    utf8_sequences((lo | m) + 1, hi, out);
+                    return;
+                }
+                if ((hi & m) != m) {
+                    utf8_sequences(lo, (hi & ~m) - 1, out);
+                    utf8_sequences(hi & ~m, hi, out);
+                    return;
+                }
+            }
+        }
+        std::string first = encode_utf8(lo);
+        std::string last = encode_utf8(hi);
+        byte_sequence sequence;
+        for (std::size_t k = 0; k < first.size(); k++) {
+            sequence.push_back({static_cast<std::uint8_t>(first[k]), static_cast<std::uint8_t>(last[k])});
+        }
+        out.push_back(sequence);
+    }
+}
+
+regex_program::regex_program(const regex_node &root) {
+    for (bool reversed : {false, true}) {
+        std::vector<instruction> &program = reversed ? backward : forward;
+        std::uint32_t match = add(program, {instruction::MATCH, 0, 0, 0, 0});
+        (reversed ? backward_start : forward_start) = compile(program, root, match, reversed);
+    }
+}
+
+std::uint32_t regex_program::add(std::vector<instruction> &program, instruction i) {
+    if (program.size() >= MAX_INSTRUCTIONS) {
+        big = true;
+        return 0;
+    }
+    program.push_back(i);
+    return static_cast<std::uint32_t>(program.size() - 1);
+}
+
+/* built from the end, the code of a node continues at next; the reversed program reads text backwards */
+std::uint32_t regex_program::compile(std::vector<instruction> &program, const regex_node &node, std::uint32_t next,
+                                     bool reversed) {
+    if (big) {
+        return next;
+    }
+    std::uint32_t entry = next;
+    switch (node.kind) {
+        case regex_node::EMPTY:
+            break;
+        case regex_node::LITERAL:
+            for (std::size_t k = 0; k < node.text.size(); k++) {
+                std::uint8_t c = static_cast<std::uint8_t>(node.text[reversed ? k : node.text.size() - 1 - k]);
+                entry = add(program, {instruction::RANGE, c, c, entry, 0});
+            }
+            break;
+        case regex_node::CLASS: {
+            std::vector<byte_sequence> sequences;
+            for (const auto &r : node.ranges) {
+                utf8_sequences(r.first, r.second, sequences);
+            }
+            /* a class matching nothing */
+            entry = add(program, {instruction::RANGE, 1, 0, next, 0});
+            for (std::size_t i = 0; i < sequences.size(); i++) {
+                const byte_sequence &sequence = sequences[i];
+                std::uint32_t chain = next;
+                for (std::size_t k = 0; k < sequence.size(); k++) {
+                    const auto &range = sequence[reversed ? k : sequence.size() - 1 - k];
+                    chain = add(program, {instruction::RANGE, range.first, range.second, chain, 0});
+                }
+                entry = i == 0 ? chain : add(program, {instruction::SPLIT, 0, 0, chain, entry});
+            }
+            break;
+        }
+        case regex_node::CONCAT:
+            for (std::size_t k = 0; k < node.subs.size(); k++) {
+                entry = compile(program, node.subs[reversed ? k : node.subs.size() - 1 - k], entry, reversed);
+            }
+            break;
+        case regex_node::ALTERNATE:
+            entry = compile(program, node.subs.back(), next, reversed);
+            for (std::size_t k = node.subs.size() - 1; k-- > 0;) {
+                std::uint32_t branch = compile(program, node.subs[k], next, reversed);
+                entry = add(program, {instruction::SPLIT, 0, 0, branch, entry});
+            }
+            break;
+        case regex_node::REPEAT:
+            if (node.max == -1) {
+                std::uint32_t loop = add(program, {instruction::SPLIT, 0, 0, next, next});
+                std::uint32_t body = compile(program, node.subs[0], loop, reversed);
+                if (!big) program[loop].out = body;
+                entry = loop;
+            } else {
+                for (int k = node.min; k < node.max && !big; k++) {
+                    std::uint32_t body = compile(program, node.subs[0], entry, reversed);
+                    entry = add(program, {instruction::SPLIT, 0, 0, body, next});
+                }
+            }
+            for (int k = 0; k < node.min && !big; k++) {
+                entry = compile(program, node.subs[0], entry, reversed);
+            }
+            break;
+        case regex_node::BEGIN_LINE:
+        case regex_node::END_LINE: {
+            bool begin = (node.kind == regex_node::BEGIN_LINE) != reversed;
+            entry = add(program, {begin ? instruction::BEGIN_LINE : instruction::END_LINE, 0, 0, next, 0});
+            break;
+        }
+    }
+    return big ? next : entry;
+}
+
+regex_matcher::regex_matcher(const regex_program &program) {
+    init(forward, program.forward, program.forward_start, true);
+    init(anchored, program.forward, program.forward_start, false);
+    init(backward, program.backward, program.backward_start, true);
+    marks.assign(std::max(program.forward.size(), program.backward.size()), 0);
+}
+
+void regex_matcher::init(automaton &a, const std::vector<regex_program::instruction> &program, std::uint32_t start,
+                         bool unanchored) {
+    a.program = &program;
+    a.start = start;
+    a.unanchored = unanchored;
+    a.sets.clear();
+    a.numbers.clear();
+    a.transitions.clear();
+    a.matching.clear();
+    a.starts[0] = a.starts[1] = -1;
+}
+
+/* the instructions reachable from seeds without reading a byte, which wait for one or match */
+std::vector<std::uint32_t> regex_matcher::closure(const automaton &a, std::vector<std::uint32_t> &seeds,
+                                                  bool at_begin) {
+    const std::vector<regex_program::instruction> &program = *a.program;
+    if (++generation == 0) {
+        std::fill(marks.begin(), marks.end(), 0);
+        generation = 1;
+    }
+    std::vector<std::uint32_t> set;
+    stack.assign(seeds.rbegin(), seeds.rend());
+    while (!stack.empty()) {
+        std::uint32_t i = stack.back();
+        stack.pop_back();
+        if (marks[i] == generation) continue;
+        marks[i] = generation;
+        const regex_program::instruction &instruction = program[i];
+        switch (instruction.op) {
+            case regex_program::instruction::SPLIT:
+                stack.push_back(instruction.out1);
+                stack.push_back(instruction.out);
+                break;
+            case regex_program::instruction::BEGIN_LINE:
+                if (at_begin) stack.push_back(instruction.out);
+                break;
+            default:
+                set.push_back(i);
+        }
+    }
+    std::sort(set.begin(), set.end());
+    return set;
+}
+
+int regex_matcher::state(automaton &a, std::vector<std::uint32_t> &&set) {
+    auto it = a.numbers.find(set);
+    if (it != a.numbers.end()) {
+        return it->second;
+    }
+    if (a.sets.size() >= MAX_STATES) {
+        init(a, *a.program, a.start, a.unanchored);
+        a.flushes++;
+    }
+    int number = static_cast<int>(a.sets.size());
+    /* the match instruction is the first one */
+    a.matching.push_back(!set.empty() && set[0] == 0);
+    a.numbers.emplace(set, number);
+    a.sets.push_back(std::move(set));
+    a.transitions.resize(a.transitions.size() + SYMBOLS, -1);
+    return number;
+}
+
+int regex_matcher::start(automaton &a, bool at_begin) {
+    if (a.starts[at_begin] < 0) {
+        std::vector<std::uint32_t> seeds = {a.start};
+        int number = state(a, closure(a, seeds, at_begin));
+        a.starts[at_begin] = number;
+    }
+    return a.starts[at_begin];
+}
+
+int regex_matcher::build(automaton &a, int from, int symbol) {
+    const std::vector<regex_program::instruction> &program = *a.program;
+    std::vector<std::uint32_t> seeds;
+    for (std::uint32_t i : a.sets[from]) {
+        const regex_program::instruction &instruction = program[i];
+        if (symbol == END) {
+            if (instruction.op == regex_program::instruction::END_LINE) seeds.push_back(instruction.out);
+        } else if (instruction.op == regex_program::instruction::RANGE &&
+                   instruction.lo <= symbol && symbol <= instruction.hi) {
+            seeds.push_back(instruction.out);
+        }
+    }
+    if (a.unanchored && symbol != END) {
+        seeds.push_back(a.start);
+    }
+    std::size_t flushes = a.flushes;
+    int to = state(a, closure(a, seeds, false));
+    if (a.flushes == flushes) {
+        a.transitions[from * SYMBOLS + symbol] = to;
+    }
+    return to;
+}
+
+std::int64_t regex_matcher::find_line(char const *data, std::size_t len) {
+    std::size_t line = 0;
+    int s = start(forward, true);
+    if (len > 0 && forward.matching[s]) {
+        return 0;
+    }
+    for (std::size_t i = 0; i < len; i++) {
+        std::uint8_t c = static_cast<std::uint8_t>(data[i]);
+        if (c == '\n') {
+            if (forward.matching[next(forward, s, END)]) {
+                return static_cast<std::int64_t>(line);
+            }
+            line = i + 1;
+            s = start(forward, true);
+            if (line < len && forward.matching[s]) {
+                return static_cast<std::int64_t>(line);
+            }
+            continue;
+        }
+        s = next(forward, s, c);
+        if (forward.matching[s]) {
+            return static_cast<std::int64_t>(line);
+        }
+    }
+    if (line < len && forward.matching[next(forward, s, END)]) {
+        return static_cast<std::int64_t>(line);
+    }
+    return -1;
+}
+
+/*
+ * The reversed expression read from the end of the line marks where matches
+ * start, then the longest match is read forwards from each leftmost start.
+ */
+void regex_matcher::find_in_line(char const *line, std::size_t len,
+                                 std::vector<std::pair<std::size_t, std::size_t>> &matches) {
+    matches.clear();
+    std::vector<char> starts(len + 1);
+    int s = start(backward, true);
+    starts[len] = backward.matching[s];
+    for (std::size_t p = len; p-- > 0;) {
+        s = next(backward, s, static_cast<std::uint8_t>(line[p]));
+        starts[p] = backward.matching[s];
+    }
+    starts[0] |= backward.matching[next(backward, s, END)];
+
+    for (std::size_t from = 0; from <= len;) {
+        std::size_t p = from;
+        while (p <= len && !starts[p]) p++;
+        if (p > len) {
+            break;
+        }
+        s = start(anchored, p == 0);
+        std::int64_t end = anchored.matching[s] ? static_cast<std::int64_t>(p) : -1;
+        std::size_t i = p;
+        for (; i < len && !anchored.sets[s].empty(); i++) {
+            s = next(anchored, s, static_cast<std::uint8_t>(line[i]));
+            if (anchored.matching[s]) end = static_cast<std::int64_t>(i + 1);
+        }
+        if (i == len && anchored.matching[next(anchored, s, END)]) {
+            end = static_cast<std::int64_t>(len);
+        }
+        if (end >= 0) {
+            matches.push_back({p, static_cast<std::size_t>(end) - p});
+        }
+        from = end > static_cast<std::int64_t>(p) ? static_cast<std::size_t>(end) : p + 1;
+        while (from < len && is_continuation(line[from])) from++;
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef REGEX_MATCHER_H
+#define REGEX_MATCHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "regex_parser.h"
+
+/*
+ * Regular expression compiled into automata over bytes: one for the
+ * expression and one for its reversal. Shared by the verifying threads.
+ */
+class regex_program {
+public:
+    struct instruction {
+        enum opcode {RANGE, SPLIT, BEGIN_LINE, END_LINE, MATCH};
+        opcode op;
+        std::uint8_t lo;
+        std::uint8_t hi;
+        std::uint32_t out;
+        std::uint32_t out1;
+    };
+
+    static const std::size_t MAX_INSTRUCTIONS = 1 << 18;
+
+    explicit regex_program(const regex_node &root);
+
+    /* the expression was not compiled as it needs more than MAX_INSTRUCTIONS */
+    bool too_big() const { return big; }
+
+private:
+    std::vector<instruction> forward;
+    std::vector<instruction> backward;
+    std::uint32_t forward_start;
+    std::uint32_t backward_start;
+    bool big = false;
+
+    std::uint32_t add(std::vector<instruction> &program, instruction i);
+    std::uint32_t compile(std::vector<instruction> &program, const regex_node &node, std::uint32_t next, bool reversed);
+
+    friend class regex_matcher;
+};
+
+/*
+ * Lazily built DFAs of one program, one matcher per thread. Matches do not
+ * span lines; of the matches starting leftmost the longest one is taken.
+ */
+class regex_matcher {
+    /* symbol of the end of a line, after the 256 bytes */
+    static const int END = 256;
+    static const int SYMBOLS = 257;
+    /* the cache of DFA states is dropped when it reaches this size */
+    static const std::size_t MAX_STATES = 1024;
+
+    struct automaton {
+        const std::vector<regex_program::instruction> *program;
+        std::uint32_t start;
+        /* a match may start at every position */
+        bool unanchored;
+        std::vector<std::vector<std::uint32_t>> sets;
+        std::map<std::vector<std::uint32_t>, int> numbers;
+        /* SYMBOLS per state, -1 if not built yet */
+        std::vector<int> transitions;
+        std::vector<char> matching;
+        /* elsewhere and at the beginning of a line */
+        int starts[2];
+        /* how many times the states were dropped, which invalidates their numbers */
+        std::size_t flushes = 0;
+    };
+
+    automaton forward;
+    automaton anchored;
+    automaton backward;
+    std::vector<std::uint32_t> marks;
+    std::uint32_t generation = 0;
+    std::vector<std::uint32_t> stack;
+
+    void init(automaton &a, const std::vector<regex_program::instruction> &program, std::uint32_t start,
+              bool unanchored);
+    std::vector<std::uint32_t> closure(const automaton &a, std::vector<std::uint32_t> &seeds, bool at_begin);
+    int state(automaton &a, std::vector<std::uint32_t> &&set);
+    int start(automaton &a, bool at_begin);
+    int next(automaton &a, int from, int symbol) {
+        int to = a.transitions[from * SYMBOLS + symbol];
+        return to >= 0 ? to : build(a, from, symbol);
+    }
+    int build(automaton &a, int from, int symbol);
+
+public:
+    explicit regex_matcher(const regex_program &program);
+
+    /* offset of the first line with a match or -1, data is made of whole lines */
+    std::int64_t find_line(char const *data, std::size_t len);
+    /* (offset, length) of the matches in one line without its newline, they do not overlap */
+    void find_in_line(char const *line, std::size_t len, std::vector<std::pair<std::size_t, std::size_t>> &matches);
+};
+
+#endif // REGEX_MATCHER_H
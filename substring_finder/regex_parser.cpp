@@ -0,0 +1,372 @@
+#include "regex_parser.h"
+#include "utf8_validator.hpp"
+#include "utf8.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+    typedef std::vector<std::pair<std::uint32_t, std::uint32_t>> code_ranges;
+
+    const std::uint32_t MAX_CODE_POINT = 0x10ffff;
+    const int MAX_REPEAT = 1000;
+    const int MAX_DEPTH = 256;
+
+    /* sorts and merges the ranges, cutting the newline out */
+    void normalize(code_ranges &ranges) {
+        std::sort(ranges.begin(), ranges.end());
+        code_ranges merged;
+        for (const auto &r : ranges) {
+            if (!merged.empty() && r.first <= merged.back().second + 1) {
+                merged.back().second = std::max(merged.back().second, r.second);
+            } else {
+                merged.push_back(r);
+            }
+        }
+        ranges.clear();
+        for (const auto &r : merged) {
+            if (r.first <= '\n' && '\n' <= r.second) {
+                if (r.first < '\n') ranges.push_back({r.first, '\n' - 1});
+                if (r.second > '\n') ranges.push_back({'\n' + 1, r.second});
+            } else {
+                ranges.push_back(r);
+            }
+        }
+    }
+
+    code_ranges negate(const code_ranges &ranges) {
+        code_ranges result;
+        std::uint32_t next = 0;
+        for (const auto &r : ranges) {
+            if (r.first > next) result.push_back({next, r.first - 1});
+            next = r.second + 1;
+        }
+        if (next <= MAX_CODE_POINT) result.push_back({next, MAX_CODE_POINT});
+        normalize(result);
+        return result;
+    }
+
+    void add_other_case(code_ranges &ranges) {
+        std::size_t n = ranges.size();
+        for (std::size_t i = 0; i < n; i++) {
+            std::uint32_t lo = std::max<std::uint32_t>(ranges[i].first, 'A');
+            std::uint32_t hi = std::min<std::uint32_t>(ranges[i].second, 'Z');
+            if (lo <= hi) ranges.push_back({lo + 32, hi + 32});
+            lo = std::max<std::uint32_t>(ranges[i].first, 'a');
+            hi = std::min<std::uint32_t>(ranges[i].second, 'z');
+            if (lo <= hi) ranges.push_back({lo - 32, hi - 32});
+        }
+        normalize(ranges);
+    }
+
+    class regex_parser {
+        const std::string &pattern;
+        std::size_t position = 0;
+        bool ignore_case;
+        int depth = 0;
+
+        bool at_end() const { return position >= pattern.size(); }
+        char peek() const { return pattern[position]; }
+
+        bool fail(const std::string &message) {
+            if (error.empty()) error = message + " at position " + std::to_string(position + 1);
+            return false;
+        }
+
+        bool alternation(regex_node &out) {
+            if (++depth > MAX_DEPTH) {
+                return fail("pattern is nested too deeply");
+            }
+            regex_node first;
+            if (!concatenation(first)) {
+                return false;
+            }
+            if (at_end() || peek() != '|') {
+                out = std::move(first);
+            } else {
+                out = regex_node();
+                out.kind = regex_node::ALTERNATE;
+                out.subs.push_back(std::move(first));
+                while (!at_end() && peek() == '|') {
+                    position++;
+                    regex_node next;
+                    if (!concatenation(next)) {
+                        return false;
+                    }
+                    out.subs.push_back(std::move(next));
+                }
+            }
+            depth--;
+            return true;
+        }
+
+        bool concatenation(regex_node &out) {
+            out.kind = regex_node::CONCAT;
+            while (!at_end() && peek() != '|' && peek() != ')') {
+                regex_node item;
+                if (!repetition(item)) {
+                    return false;
+                }
+                out.subs.push_back(std::move(item));
+            }
+            if (out.subs.empty()) {
+                out.kind = regex_node::EMPTY;
+            } else if (out.subs.size() == 1) {
+                regex_node only = std::move(out.subs[0]);
+                out = std::move(only);
+            }
+            return true;
+        }
+
+        bool repetition(regex_node &out) {
+            if (!atom(out)) {
+                return false;
+            }
+            while (!at_end()) {
+                int min, max;
+                char c = peek();
+                if (c == '*' || c == '+' || c == '?') {
+                    min = c == '+' ? 1 : 0;
+                    max = c == '?' ? 1 : -1;
+                    position++;
+                } else if (c != '{' || !counts(min, max)) {
+                    break;
+                }
+                if (!error.empty()) {
+                    return false;
+                }
+                regex_node repeat;
+                repeat.kind = regex_node::REPEAT;
+                repeat.min = min;
+                repeat.max = max;
+                repeat.subs.push_back(std::move(out));
+                out = std::move(repeat);
+            }
+            return true;
+        }
+
+        /* {m}, {m,} or {m,n}, a brace which does not start one is a literal */
+        bool counts(int &min, int &max) {
+            std::size_t p = position + 1;
+            auto number = [&](int &value) {
+                std::size_t start = p;
+                value = 0;
+                for (; p < pattern.size() && pattern[p] >= '0' && pattern[p] <= '9'; p++) {
+                    value = std::min(value * 10 + (pattern[p] - '0'), MAX_REPEAT + 1);
+                }
+                return p > start;
+            };
+            if (!number(min)) {
+                return false;
+            }
+            max = min;
+            if (p < pattern.size() && pattern[p] == ',') {
+                p++;
+                if (!number(max)) max = -1;
+            }
+            if (p >= pattern.size() || pattern[p] != '}') {
+                return false;
+            }
+            if (min > MAX_REPEAT || max > MAX_REPEAT) {
+                fail("repetition count is above 1000");
+            } else if (max != -1 && max < min) {
+                fail("invalid repetition count");
+            }
+            position = p + 1;
+            return true;
+        }
+
+        bool atom(regex_node &out) {
+            code_ranges ranges;
+            switch (peek()) {
+                case '(':
+                    position++;
+                    if (pattern.compare(position, 2, "?:") == 0) {
+                        position += 2;
+                    } else if (!at_end() && peek() == '?') {
+                        return fail("unsupported group");
+                    }
+                    if (!alternation(out)) {
+                        return false;
+                    }
+                    if (at_end() || peek() != ')') {
+                        return fail("missing )");
+                    }
+                    position++;
+                    return true;
+                case '*':
+                case '+':
+                case '?':
+                    return fail("nothing to repeat");
+                case '[':
+                    return character_class(out);
+                case '.':
+                    position++;
+                    set_class(out, {{0, MAX_CODE_POINT}});
+                    return true;
+                case '^':
+                    position++;
+                    out.kind = regex_node::BEGIN_LINE;
+                    return true;
+                case '$':
+                    position++;
+                    out.kind = regex_node::END_LINE;
+                    return true;
+                case '\\':
+                    if (!escape(ranges)) {
+                        return false;
+                    }
+                    set_class(out, ranges);
+                    return true;
+                default:
+                    std::uint32_t code_point;
+                    if (!next_code_point(code_point)) {
+                        return false;
+                    }
+                    set_class(out, {{code_point, code_point}});
+                    return true;
+            }
+        }
+
+        bool next_code_point(std::uint32_t &code_point) {
+            std::uint32_t state = UTF8_ACCEPT;
+            do {
+                decode_utf8(&state, &code_point, static_cast<std::uint8_t>(pattern[position++]));
+            } while (!at_end() && state != UTF8_ACCEPT && state != UTF8_REJECT);
+            if (state != UTF8_ACCEPT) {
+                return fail("invalid UTF-8");
+            }
+            if (code_point == '\n') {
+                return fail("a match cannot span lines");
+            }
+            return true;
+        }
+
+        /* a class of one character becomes a literal */
+        void set_class(regex_node &out, code_ranges ranges) {
+            if (ignore_case) add_other_case(ranges);
+            normalize(ranges);
+            if (ranges.size() == 1 && ranges[0].first == ranges[0].second) {
+                out.kind = regex_node::LITERAL;
+                out.text = encode_utf8(ranges[0].first);
+            } else {
+                out.kind = regex_node::CLASS;
+                out.ranges = std::move(ranges);
+            }
+        }
+
+        bool escape(code_ranges &ranges) {
+            position++;
+            if (at_end()) {
+                return fail("trailing \\");
+            }
+            char c = pattern[position++];
+            const code_ranges digits = {{'0', '9'}};
+            const code_ranges word = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+            const code_ranges spaces = {{'\t', '\t'}, {'\v', '\r'}, {' ', ' '}};
+            switch (c) {
+                case 'd': ranges = digits; break;
+                case 'D': ranges = negate(digits); break;
+                case 'w': ranges = word; break;
+                case 'W': ranges = negate(word); break;
+                case 's': ranges = spaces; break;
+                case 'S': ranges = negate(spaces); break;
+                case 't': ranges = {{'\t', '\t'}}; break;
+                case 'r': ranges = {{'\r', '\r'}}; break;
+                case 'f': ranges = {{'\f', '\f'}}; break;
+                case 'v': ranges = {{'\v', '\v'}}; break;
+                case 'n':
+                    position--;
+                    return fail("a match cannot span lines");
+                default:
+                    position--;
+                    if (static_cast<std::uint8_t>(c) >= 0x80 || std::isalnum(static_cast<unsigned char>(c))) {
+                        return fail(std::string("unsupported escape \\") + c);
+                    }
+                    position++;
+                    ranges = {{static_cast<std::uint8_t>(c), static_cast<std::uint8_t>(c)}};
+            }
+            return true;
+        }
+
+        bool character_class(regex_node &out) {
+            position++;
+            bool negated = !at_end() && peek() == '^';
+            if (negated) position++;
+            code_ranges ranges;
+            for (bool first = true;; first = false) {
+                if (at_end()) {
+                    return fail("missing ]");
+                }
+                if (peek() == ']' && !first) {
+                    position++;
+                    break;
+                }
+                std::uint32_t lo, hi;
+                if (!class_character(lo, ranges)) {
+                    if (!error.empty()) return false;
+                    continue;
+                }
+                hi = lo;
+                if (position + 1 < pattern.size() && peek() == '-' && pattern[position + 1] != ']') {
+                    position++;
+                    code_ranges set;
+                    if (!class_character(hi, set)) {
+                        return fail("invalid range");
+                    }
+                    if (hi < lo) {
+                        return fail("invalid range");
+                    }
+                }
+                ranges.push_back({lo, hi});
+            }
+            if (ignore_case) add_other_case(ranges);
+            normalize(ranges);
+            out.kind = regex_node::CLASS;
+            out.ranges = negated ? negate(ranges) : ranges;
+            return true;
+        }
+
+        /* false if it is an escaped set, which is added to ranges */
+        bool class_character(std::uint32_t &code_point, code_ranges &ranges) {
+            if (peek() != '\\') {
+                return next_code_point(code_point);
+            }
+            code_ranges set;
+            if (!escape(set)) {
+                return false;
+            }
+            if (set.size() == 1 && set[0].first == set[0].second) {
+                code_point = set[0].first;
+                return true;
+            }
+            ranges.insert(ranges.end(), set.begin(), set.end());
+            return false;
+        }
+
+    public:
+        std::string error;
+
+        regex_parser(const std::string &pattern, bool ignore_case) : pattern(pattern), ignore_case(ignore_case) {}
+
+        bool parse(regex_node &root) {
+            if (!alternation(root)) {
+                return false;
+            }
+            if (!at_end()) {
+                return fail("unmatched )");
+            }
+            return true;
+        }
+    };
+}
+
+bool parse_regex(const std::string &pattern, bool ignore_case, regex_node &root, std::string &error) {
+    regex_parser parser(pattern, ignore_case);
+    root = regex_node();
+    if (!parser.parse(root)) {
+        error = parser.error;
+        return false;
+    }
+    return true;
+}
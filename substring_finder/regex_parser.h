@@ -0,0 +1,35 @@
+#ifndef REGEX_PARSER_H
+#define REGEX_PARSER_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Syntax tree of a regular expression over UTF-8 text. Matches never span
+ * lines, so no class contains the newline.
+ */
+struct regex_node {
+    enum node_kind {EMPTY, LITERAL, CLASS, CONCAT, ALTERNATE, REPEAT, BEGIN_LINE, END_LINE};
+
+    node_kind kind = EMPTY;
+    /* LITERAL: one character in UTF-8 */
+    std::string text;
+    /* CLASS: sorted disjoint ranges of code points */
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges;
+    /* CONCAT, ALTERNATE and REPEAT */
+    std::vector<regex_node> subs;
+    /* REPEAT: max is -1 if unbounded */
+    int min = 0;
+    int max = -1;
+};
+
+/*
+ * Supports literals, ., [] classes, \d \w \s and their negations, (), (?:),
+ * |, * + ? {m,n} and the line anchors ^ $. Ignoring case applies to ASCII
+ * letters. False with a message if the pattern cannot be parsed.
+ */
+bool parse_regex(const std::string &pattern, bool ignore_case, regex_node &root, std::string &error);
+
+#endif // REGEX_PARSER_H
@@ -0,0 +1,358 @@
+#include "regex_query.h"
+#include "utf8.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+
+trigram_query trigram_query::keys(std::vector<trigram> trigrams) {
+    trigram_query query;
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    if (!trigrams.empty()) {
+        query.kind = AND;
+        query.trigrams = std::move(trigrams);
+    }
+    return query;
+}
+
+trigram_query trigram_query::conjunction(trigram_query a, trigram_query b) {
+    if (a.kind == NONE || b.kind == ALL) return a;
+    if (b.kind == NONE || a.kind == ALL) return b;
+    trigram_query result;
+    result.kind = AND;
+    for (trigram_query *x : {&a, &b}) {
+        if (x->kind == AND) {
+            result.trigrams.insert(result.trigrams.end(), x->trigrams.begin(), x->trigrams.end());
+            std::move(x->subs.begin(), x->subs.end(), std::back_inserter(result.subs));
+        } else {
+            result.subs.push_back(std::move(*x));
+        }
+    }
+    std::sort(result.trigrams.begin(), result.trigrams.end());
+    result.trigrams.erase(std::unique(result.trigrams.begin(), result.trigrams.end()), result.trigrams.end());
+    return result;
+}
+
+trigram_query trigram_query::disjunction(trigram_query a, trigram_query b) {
+    if (a.kind == ALL || b.kind == NONE) return a;
+    if (b.kind == ALL || a.kind == NONE) return b;
+    trigram_query result;
+    result.kind = OR;
+    for (trigram_query *x : {&a, &b}) {
+        if (x->kind == OR) {
+            result.trigrams.insert(result.trigrams.end(), x->trigrams.begin(), x->trigrams.end());
+            std::move(x->subs.begin(), x->subs.end(), std::back_inserter(result.subs));
+        } else if (x->trigrams.size() == 1 && x->subs.empty()) {
+            result.trigrams.push_back(x->trigrams[0]);
+        } else {
+            result.subs.push_back(std::move(*x));
+        }
+    }
+    std::sort(result.trigrams.begin(), result.trigrams.end());
+    result.trigrams.erase(std::unique(result.trigrams.begin(), result.trigrams.end()), result.trigrams.end());
+    return result;
+}
+
+static std::string gram_text(trigram t) {
+    std::size_t length = gram_length(t);
+    std::string text;
+    for (std::size_t i = length; i-- > 0;) {
+        text.push_back(static_cast<char>(t >> (8 * i)));
+    }
+    return "\"" + text + "\"";
+}
+
+std::string trigram_query::describe() const {
+    if (kind == ALL) return "*";
+    if (kind == NONE) return "-";
+    std::string separator = kind == AND ? " " : " | ";
+    std::string text;
+    for (trigram t : trigrams) {
+        if (!text.empty()) text += separator;
+        text += gram_text(t);
+    }
+    for (const trigram_query &sub : subs) {
+        if (!text.empty()) text += separator;
+        text += sub.describe();
+    }
+    return "(" + text + ")";
+}
+
+namespace {
+    typedef std::set<std::string> string_set;
+
+    /* bigger sets are cut down to trigrams */
+    const std::size_t MAX_EXACT = 16;
+    const std::size_t MAX_SET = 32;
+
+    std::size_t min_length(const string_set &set) {
+        if (set.empty()) return 0;
+        std::size_t length = SIZE_MAX;
+        for (const std::string &s : set) length = std::min(length, s.size());
+        return length;
+    }
+
+    string_set cross(const string_set &x, const string_set &y) {
+        string_set result;
+        for (const std::string &a : x) {
+            for (const std::string &b : y) result.insert(a + b);
+        }
+        return result;
+    }
+
+    string_set unite(string_set x, const string_set &y) {
+        x.insert(y.begin(), y.end());
+        return x;
+    }
+
+    /* one of the strings occurs in the text */
+    trigram_query and_strings(trigram_query query, const string_set &set, bool short_grams) {
+        if (!short_grams && !set.empty() && min_length(set) < GRAM_SIZE) {
+            return query;
+        }
+        trigram_query any;
+        any.kind = trigram_query::NONE;
+        for (const std::string &s : set) {
+            any = trigram_query::disjunction(std::move(any), trigram_query::keys(query_trigrams(s.data(), s.size())));
+        }
+        return trigram_query::conjunction(std::move(query), std::move(any));
+    }
+
+    /* what a node tells about its matches */
+    struct regex_info {
+        bool emptyable = false;
+        /* if has_exact, a match is one of exact, otherwise it starts with one of prefix and ends with one of suffix */
+        bool has_exact = false;
+        string_set exact;
+        string_set prefix;
+        string_set suffix;
+        trigram_query match;
+
+        static regex_info empty_string() {
+            regex_info info;
+            info.emptyable = true;
+            info.has_exact = true;
+            info.exact = {""};
+            return info;
+        }
+
+        static regex_info any_char() {
+            regex_info info;
+            info.prefix = {""};
+            info.suffix = {""};
+            return info;
+        }
+
+        static regex_info any_match() {
+            regex_info info = any_char();
+            info.emptyable = true;
+            return info;
+        }
+
+        void add_exact(bool short_grams = false) {
+            if (has_exact) match = and_strings(std::move(match), exact, short_grams);
+        }
+
+        void simplify_set(string_set &set, bool is_suffix) {
+            match = and_strings(std::move(match), set, false);
+            for (std::size_t length = GRAM_SIZE - 1;; length--) {
+                string_set cut;
+                for (const std::string &s : set) {
+                    if (s.size() <= length) {
+                        cut.insert(s);
+                    } else {
+                        cut.insert(is_suffix ? s.substr(s.size() - length) : s.substr(0, length));
+                    }
+                }
+                set.swap(cut);
+                if (set.size() <= MAX_SET || length == 0) break;
+            }
+            /* a string of which another one is a prefix (suffix) tells nothing more */
+            string_set kept;
+            for (const std::string &s : set) {
+                bool redundant = false;
+                for (std::size_t n = 0; n < s.size() && !redundant; n++) {
+                    redundant = set.count(is_suffix ? s.substr(s.size() - n) : s.substr(0, n)) > 0;
+                }
+                if (!redundant) kept.insert(s);
+            }
+            set.swap(kept);
+        }
+
+        void simplify(bool force) {
+            std::size_t length = min_length(exact);
+            if (has_exact && (exact.size() > MAX_EXACT || (length >= GRAM_SIZE && force) || length > GRAM_SIZE)) {
+                add_exact();
+                for (const std::string &s : exact) {
+                    if (s.size() < GRAM_SIZE) {
+                        prefix.insert(s);
+                        suffix.insert(s);
+                    } else {
+                        prefix.insert(s.substr(0, GRAM_SIZE - 1));
+                        suffix.insert(s.substr(s.size() - GRAM_SIZE + 1));
+                    }
+                }
+                exact.clear();
+                has_exact = false;
+            }
+            if (!has_exact) {
+                simplify_set(prefix, false);
+                simplify_set(suffix, true);
+            }
+        }
+    };
+
+    regex_info concat(regex_info x, regex_info y) {
+        regex_info xy;
+        xy.match = trigram_query::conjunction(x.match, y.match);
+        if (x.has_exact && y.has_exact) {
+            xy.has_exact = true;
+            xy.exact = cross(x.exact, y.exact);
+        } else {
+            if (x.has_exact) {
+                xy.prefix = cross(x.exact, y.prefix);
+            } else {
+                xy.prefix = x.emptyable ? unite(x.prefix, y.prefix) : x.prefix;
+            }
+            if (y.has_exact) {
+                xy.suffix = cross(x.suffix, y.exact);
+            } else {
+                xy.suffix = y.emptyable ? unite(y.suffix, x.suffix) : y.suffix;
+            }
+        }
+        /* one of the strings across the boundary occurs, its trigrams are not in prefix or suffix yet */
+        if (!x.has_exact && !y.has_exact && x.suffix.size() <= MAX_SET && y.prefix.size() <= MAX_SET &&
+                min_length(x.suffix) + min_length(y.prefix) >= GRAM_SIZE) {
+            xy.match = and_strings(std::move(xy.match), cross(x.suffix, y.prefix), false);
+        }
+        xy.emptyable = x.emptyable && y.emptyable;
+        xy.simplify(false);
+        return xy;
+    }
+
+    regex_info alternate(regex_info x, regex_info y) {
+        regex_info xy;
+        if (x.has_exact && y.has_exact) {
+            xy.has_exact = true;
+            xy.exact = unite(x.exact, y.exact);
+        } else if (x.has_exact) {
+            xy.prefix = unite(x.exact, y.prefix);
+            xy.suffix = unite(x.exact, y.suffix);
+            x.add_exact();
+        } else if (y.has_exact) {
+            xy.prefix = unite(x.prefix, y.exact);
+            xy.suffix = unite(x.suffix, y.exact);
+            y.add_exact();
+        } else {
+            xy.prefix = unite(x.prefix, y.prefix);
+            xy.suffix = unite(x.suffix, y.suffix);
+        }
+        xy.emptyable = x.emptyable || y.emptyable;
+        xy.match = trigram_query::disjunction(std::move(x.match), std::move(y.match));
+        xy.simplify(false);
+        return xy;
+    }
+
+    std::uint64_t class_size(const regex_node &node) {
+        std::uint64_t size = 0;
+        for (const auto &r : node.ranges) size += r.second - r.first + 1;
+        return size;
+    }
+
+    regex_info analyze(const regex_node &node) {
+        regex_info info;
+        switch (node.kind) {
+            case regex_node::EMPTY:
+            case regex_node::BEGIN_LINE:
+            case regex_node::END_LINE:
+                return regex_info::empty_string();
+            case regex_node::LITERAL:
+                info.has_exact = true;
+                info.exact = {node.text};
+                return info;
+            case regex_node::CLASS:
+                if (class_size(node) > MAX_EXACT) {
+                    return regex_info::any_char();
+                }
+                info.has_exact = true;
+                for (const auto &r : node.ranges) {
+                    for (std::uint32_t c = r.first; c <= r.second; c++) info.exact.insert(encode_utf8(c));
+                }
+                return info;
+            case regex_node::CONCAT:
+                info = regex_info::empty_string();
+                for (const regex_node &sub : node.subs) {
+                    info = concat(std::move(info), analyze(sub));
+                }
+                return info;
+            case regex_node::ALTERNATE:
+                info = analyze(node.subs[0]);
+                for (std::size_t i = 1; i < node.subs.size(); i++) {
+                    info = alternate(std::move(info), analyze(node.subs[i]));
+                }
+                return info;
+            case regex_node::REPEAT:
+                if (node.max == 0) {
+                    return regex_info::empty_string();
+                }
+                if (node.min == 0) {
+                    return node.max == 1 ? alternate(analyze(node.subs[0]), regex_info::empty_string())
+                                         : regex_info::any_match();
+                }
+                info = analyze(node.subs[0]);
+                if (node.max != 1 && info.has_exact) {
+                    /* there is at least one match of the node, but the whole is not exact any more */
+                    info.prefix = info.exact;
+                    info.suffix = info.exact;
+                    info.exact.clear();
+                    info.has_exact = false;
+                    info.simplify(false);
+                }
+                return info;
+        }
+        return regex_info::any_match();
+    }
+
+    std::vector<file_id> intersect(const std::vector<file_id> &a, const std::vector<file_id> &b) {
+        std::vector<file_id> result;
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+        return result;
+    }
+}
+
+trigram_query regex_trigram_query(const regex_node &root) {
+    regex_info info = analyze(root);
+    info.simplify(true);
+    info.add_exact(true);
+    return info.match;
+}
+
+std::vector<file_id> files_matching(const trigram_query &query, const trigram_index &index) {
+    if (query.kind == trigram_query::ALL) return index.all_files();
+    if (query.kind == trigram_query::NONE) return {};
+    std::vector<std::vector<file_id>> lists;
+    for (trigram t : query.trigrams) {
+        lists.push_back(index.files_with(t));
+    }
+    for (const trigram_query &sub : query.subs) {
+        lists.push_back(files_matching(sub, index));
+    }
+    std::vector<file_id> result;
+    if (query.kind == trigram_query::AND) {
+        std::sort(lists.begin(), lists.end(), [](const std::vector<file_id> &a, const std::vector<file_id> &b) {
+            return a.size() < b.size();
+        });
+        result = lists[0];
+        for (std::size_t i = 1; i < lists.size() && !result.empty(); i++) {
+            result = intersect(result, lists[i]);
+        }
+    } else {
+        for (const std::vector<file_id> &list : lists) {
+            result.insert(result.end(), list.begin(), list.end());
+        }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+    }
+    return result;
+}
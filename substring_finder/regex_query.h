@@ -0,0 +1,41 @@
+#ifndef REGEX_QUERY_H
+#define REGEX_QUERY_H
+
+#include <string>
+#include <vector>
+
+#include "regex_parser.h"
+#include "trigram_index.h"
+
+/*
+ * Boolean query over index keys: every text which contains a match of the
+ * regular expression it was built from satisfies it.
+ */
+struct trigram_query {
+    enum query_kind {ALL, NONE, AND, OR};
+
+    query_kind kind = ALL;
+    /* AND: all of the keys and all subqueries, OR: any of them */
+    std::vector<trigram> trigrams;
+    std::vector<trigram_query> subs;
+
+    static trigram_query keys(std::vector<trigram> trigrams);
+    static trigram_query conjunction(trigram_query a, trigram_query b);
+    static trigram_query disjunction(trigram_query a, trigram_query b);
+
+    /* e.g. ("abc" "bcd" | "xyz") */
+    std::string describe() const;
+};
+
+/*
+ * Follows the analysis of Russ Cox's codesearch: every node gets the sets of
+ * its exact strings, or of its prefixes and suffixes, which are turned into
+ * trigrams once they get too big. Short exact strings at the top fall back to
+ * bigrams and unigrams.
+ */
+trigram_query regex_trigram_query(const regex_node &root);
+
+/* first chunks of the files which satisfy the query, sorted */
+std::vector<file_id> files_matching(const trigram_query &query, const trigram_index &index);
+
+#endif // REGEX_QUERY_H
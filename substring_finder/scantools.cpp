@@ -1,27 +1,50 @@
 #include "scantools.h"
 #include "utf8_validator.hpp"
-#include "KnuthMorrisPrattAlgorithm.cpp"
+#include "utf8.hpp"
+#include "text_detector.h"
+#include "trigram_extractor.h"
+#include "substring_matcher.h"
+#include "mapped_file.h"
+#include "indexing_pipeline.h"
+#include "match_locator.h"
+#include "case_folding.h"
+#include "regex_matcher.h"
+#include "regex_query.h"
+#include "aho_corasick.h"
+#include "fuzzy_matcher.h"
 
 #include <QDir>
 #include <QDebug>
 #include <algorithm>
+#include <cstring>
+#include <unordered_set>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include <QCryptographicHash>
 #include <QFileInfoList>
 #include <QDateTime>
 #include <QThread>
 #include <QFuture>
 #include <QtConcurrent/QtConcurrent>
+#include <QStandardPaths>
 
-const size_t CHECK_SIZE = 20000;
 const size_t BLOCK_SIZE = 1024 * 1024;
-const size_t GRAM_SIZE = 3;
+const size_t CHUNK_SIZE = 4 * BLOCK_SIZE;
+const size_t CHUNK_OVERLAP = 4096;
+const size_t VERIFY_BLOCK_SIZE = 16 * 1024 * 1024;
 const QString FORMAT = "d MMMM yyyy, hh:mm:ss";
 
-scantools::scantools(bool mode) : mode(mode) {
+scantools::scantools(bool mode) : mode(mode), case_folding(false), memory_budget(0),
+                                  published(std::make_shared<trigram_index>()) {
     result = 0;
+    io_threads = 4;
+    cpu_threads = std::max(1, QThread::idealThreadCount());
     main_state = PREPARED;
     QDir::setCurrent(QDir::homePath());
-    scanning_state = SCAN_DIRS;
+    scanning_state = LOAD_INDEX;
 }
 
 void scantools::start() {
@@ -29,218 +52,996 @@ void scantools::start() {
     emit started();
     while (scanning_state != END) {
         switch (scanning_state) {
+            case LOAD_INDEX: load_index(); break;
             case SCAN_DIRS: scan_directories(); break;
             case INDEX_FILES: index_files(); break;
             default: scanning_state = END;
         }
     }
-    emit console("FINISHED", true, "green");
-    main_state = FINISHED;
-    clear();
-    emit finished();
+    if (scan_token.is_canceled()) {
+        emit console("CANCELED", true, "red");
+        clear();
+        main_state = CANCELED;
+        scan_token.reset();
+        emit canceled();
+    } else {
+        emit console("FINISHED", true, "green");
+        main_state = FINISHED;
+        clear();
+        emit finished();
+    }
     open_directory();
 }
 
+void scantools::pause() {
+    if (main_state != SCANNING) {
+        return;
+    }
+    scan_token.pause();
+    main_state = PAUSED;
+    emit console("PAUSED", true, "orange");
+    emit paused();
+}
+
+void scantools::resume() {
+    if (main_state != PAUSED) {
+        return;
+    }
+    main_state = SCANNING;
+    scan_token.resume();
+    emit console("RESUMED", true, "green");
+}
+
+void scantools::cancel() {
+    search_token.cancel();
+    if (main_state == SCANNING || main_state == PAUSED) {
+        scan_token.cancel();
+    }
+}
+
 void scantools::end() {
-    disconnect(&file_watcher, &QFileSystemWatcher::fileChanged, this, &scantools::check_file);
-    for (auto it = index.begin(); it != index.end(); it++) {
-        file_watcher.removePath(QString::fromStdString(it->first));
+    watcher.stop();
+    {
+        std::lock_guard<std::mutex> guard(changes_lock);
+        changes = directory_watcher::change_batch();
     }
+    save_index();
     index.clear();
-    indexed.clear();
+    publish();
+    cache.clear();
 }
 
 void scantools::clear() {
     main_state = PREPARED;
-    scanning_state = SCAN_DIRS;
-    files.clear();
-    while (!dirs.empty()) dirs.pop();
+    scanning_state = LOAD_INDEX;
+    seen.clear();
     emit console("", true);
 }
 
+QString scantools::index_file_name() {
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QString root = QDir(main_directory).absolutePath();
+    QByteArray key = QCryptographicHash::hash(root.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return directory + "/" + QString::fromLatin1(key) + (case_folding ? ".folded.index" : ".index");
+}
+
+void scantools::load_index() {
+    QString spill_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/spill";
+    QDir().mkpath(spill_directory);
+    index.set_memory_budget(memory_budget << 20, spill_directory.toStdString());
+    QString file_name = index_file_name();
+    if (index.size() == 0 && QFile::exists(file_name)) {
+        emit console("loading index..", true);
+        if (index.load(file_name.toStdString())) {
+            emit console(QString("index of %1 files loaded").arg(index.size()), false);
+        } else {
+            emit console("index file is stale or corrupt, rebuilding", false);
+            QFile::remove(file_name);
+        }
+    }
+    scanning_state = SCAN_DIRS;
+}
+
+bool scantools::save_index() {
+    if (index.size() == 0) {
+        return false;
+    }
+    QString file_name = index_file_name();
+    QDir().mkpath(QFileInfo(file_name).absolutePath());
+    if (!index.save(file_name.toStdString())) {
+        emit console(QString("cannot save index to ").append(file_name), true, "red");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Searches read the published copy of the index, which is never changed, so
+ * they see it as of one point in time and never wait for the writer. Copies
+ * share the mapped segments and the blocks of the file columns; the lists in
+ * memory and the blocks changed since the last copy are what is copied.
+ */
+void scantools::publish() {
+    std::atomic_store(&published, std::shared_ptr<const trigram_index>(std::make_shared<trigram_index>(index)));
+}
+
+/* what the folded trigrams cost the extracting threads, reported after the scan */
+struct folding_cost {
+    std::atomic<std::uint64_t> keys{0};
+    std::atomic<std::uint64_t> folded_keys{0};
+    std::atomic<std::uint64_t> nanoseconds{0};
+};
+
+/*
+ * Files are indexed by chunks of CHUNK_SIZE bytes. Every chunk also gets the
+ * trigrams of the first CHUNK_OVERLAP bytes of the next one, so the chunk where
+ * a match starts has all trigrams of its first CHUNK_OVERLAP + 1 bytes. Shorter
+ * grams are added for queries shorter than a gram. With folding the
+ * same grams of the case folded chunk are added under FOLDED_TAG.
+ */
+static bool read_trigrams(const mapped_file &file, trigram_set &trigrams, std::vector<chunk_trigrams> &chunks,
+                          cancellation_token *token = nullptr, folding_cost *folding = nullptr) {
+    std::uint32_t state = UTF8_ACCEPT;
+    trigram_extractor extractor;
+    folded_text folded;
+    chunks.clear();
+    size_t offset = 0;
+    std::uint64_t lines = 0;
+    std::uint64_t column = 0;
+    do {
+        std::uint64_t first_line = lines;
+        std::uint64_t first_column = column;
+        size_t end = std::min(offset + CHUNK_SIZE, file.size());
+        for (size_t block = offset; block < end; block += BLOCK_SIZE) {
+            if (token != nullptr && !token->checkpoint()) {
+                return false;
+            }
+            size_t size = std::min(BLOCK_SIZE, end - block);
+            if (text_detector::validate(&state, file.data() + block, size) == UTF8_REJECT) {
+                return false;
+            }
+            extractor.feed(file.data() + block, size, trigrams);
+            char const *begin = file.data() + block;
+            char const *line_start = begin + size;
+            while (line_start > begin && line_start[-1] != '\n') line_start--;
+            if (line_start > begin) {
+                lines += std::count(begin, line_start, '\n');
+                column = 0;
+            }
+            column += count_characters(line_start, begin + size);
+        }
+        size_t extent = std::min(end + CHUNK_OVERLAP, file.size());
+        extractor.feed(file.data() + end, extent - end, trigrams);
+        trigrams.finish();
+        file_chunk chunk = {offset, end < file.size() ? CHUNK_SIZE : file_chunk::TO_END_OF_FILE, first_line, first_column};
+        chunks.push_back({chunk, trigrams.take()});
+        std::vector<trigram> &codes = chunks.back().trigrams;
+        size_t tail = std::min<size_t>(GRAM_SIZE - 1, extent - offset);
+        add_short_grams(codes, file.data() + extent - tail, tail);
+        extractor.reset();
+        if (folding != nullptr) {
+            auto started = std::chrono::steady_clock::now();
+            folded.fold(file.data() + offset, extent - offset);
+            const std::string &text = folded.text();
+            extractor.feed(text.data(), text.size(), trigrams);
+            trigrams.finish();
+            std::vector<trigram> folded_codes = trigrams.take();
+            size_t folded_tail = std::min<size_t>(GRAM_SIZE - 1, text.size());
+            add_short_grams(folded_codes, text.data() + text.size() - folded_tail, folded_tail);
+            extractor.reset();
+            folding->keys += codes.size() + folded_codes.size();
+            folding->folded_keys += folded_codes.size();
+            for (trigram t : folded_codes) {
+                codes.push_back(FOLDED_TAG | t);
+            }
+            folding->nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - started).count();
+        }
+        offset = end;
+    } while (offset < file.size());
+    return true;
+}
+
+/* a copy follows the file it was compared with, so that file is in the index already */
+static void add_result(trigram_index &index, const index_result &result) {
+    if (!result.indexed) {
+        index.skip_file(result.path, result.fingerprint);
+    } else if (!result.copy) {
+        index.add_chunks(result.path, result.chunks, result.fingerprint, result.content);
+    } else if (!index.add_duplicate(result.path, result.fingerprint, result.content)) {
+        index.skip_file(result.path, result.fingerprint);
+    }
+}
+
+/*
+ * The crawler feeds changed and new files into the indexing pipeline while it
+ * walks the tree, this thread is the only one which writes to the index.
+ * On cancel every file which was completely read is kept in the index.
+ */
 void scantools::scan_directories() {
     emit console("scanning directories..", true);
-    if (dirs.empty()) dirs.push(main_directory);
-    while (!dirs.empty()) {
-        emit console(QString("scanning ").append(dirs.front()).append(" (0%)"), false);
-        QDir d(dirs.front());
-        QFileInfoList list = d.entryInfoList(QDir::NoDotAndDotDot | QDir::NoSymLinks | QDir::Dirs | QDir::Files);
-        for (size_t i = 0; i < list.size(); i++) {
-            emit console(QString("scanning ").append(dirs.front()).append(" (%1%)").arg((i + 1) * 100 / list.size()), false);
-            if (list[i].isDir()) dirs.push(list[i].filePath());
-            if (list[i].isFile()) {
-                files.emplace_back(list[i]);
+    emit console(QString("kernels: utf-8 validation %1, trigram extraction %2, substring search %3")
+                         .arg(text_detector::kernel_name())
+                         .arg(trigram_extractor::kernel_name())
+                         .arg(substring_matcher::kernel_name()), true);
+    std::unordered_map<std::string, file_fingerprint> known = index.known_fingerprints();
+    cancellation_token *token = &scan_token;
+    folding_cost cost;
+    folding_cost *folding = case_folding ? &cost : nullptr;
+    indexing_pipeline pipeline([token, folding] (const mapped_file &file, trigram_set &trigrams,
+                                                 std::vector<chunk_trigrams> &chunks) {
+        return read_trigrams(file, trigrams, chunks, token, folding);
+    }, io_threads, cpu_threads, token);
+    std::mutex lock;
+    std::vector<crawled_file> discovered;
+    directory_crawler crawler;
+    std::thread walker([&] {
+        crawler.crawl(QDir(main_directory).absolutePath().toStdString(), [&] (crawled_file &&f) {
+            file_fingerprint fingerprint = {f.size, f.modified};
+            auto it = known.find(f.path);
+            if (it == known.end() || it->second != fingerprint) {
+                pipeline.submit({f.path, fingerprint});
             }
+            std::lock_guard<std::mutex> guard(lock);
+            discovered.push_back(std::move(f));
+        }, token);
+        pipeline.close();
+    });
+    number_of_read = 0;
+    index_result result;
+    while (pipeline.next(result)) {
+        add_result(index, result);
+        if (++number_of_read % 256 == 0) {
+            emit console(QString("indexing files (%1 read, %2 found in %3 directories)..")
+                         .arg(number_of_read).arg(crawler.files()).arg(crawler.directories()), false);
         }
-        dirs.pop();
     }
-    emit console("scanning directories..", false);
+    walker.join();
+    if (folding != nullptr && cost.keys > 0) {
+        emit console(QString("folded index: %1 of %2 postings (%3%), %4 ms of extraction")
+                     .arg(cost.folded_keys).arg(cost.keys)
+                     .arg(100.0 * cost.folded_keys / cost.keys, 0, 'f', 1)
+                     .arg(cost.nanoseconds / 1000000), true);
+    }
+    seen.assign(index.entries().end(), false);
+    for (const crawled_file &f : discovered) {
+        file_entry entry = index.entry(f.path);
+        if (entry != file_table::NONE) seen[entry] = true;
+    }
+    number_of_found = discovered.size();
     scanning_state = INDEX_FILES;
 }
 
+/* share of the found keys which a tier held, a key can be in several tiers */
+static QString hit_rate(std::uint64_t hits, std::uint64_t lookups) {
+    return lookups == 0 ? QString("n/a") : QString("%1%").arg(100 * hits / lookups);
+}
+
+/*
+ * e.g. tiers: 3.2 MiB in memory (512 MiB), 2 segments (80.4 MiB), 5 spills, 1 merges,
+ * keys found in memory 35%, spilled 20%, base 90%
+ */
+static QString describe_tiers(const tier_stats &stats) {
+    QString budget = stats.memory_budget == 0 ? QString("no limit") : QString("%1 MiB").arg(stats.memory_budget >> 20);
+    QString text = QString("tiers: %1 MiB in memory (%2), %3 segments (%4 MiB), %5 spills, %6 merges, "
+                           "keys found in memory %7, spilled %8, base %9")
+            .arg(stats.memory / 1048576.0, 0, 'f', 1).arg(budget).arg(stats.segments)
+            .arg(stats.segment_bytes / 1048576.0, 0, 'f', 1).arg(stats.spills).arg(stats.merges)
+            .arg(hit_rate(stats.memory_hits, stats.lookups)).arg(hit_rate(stats.spilled_hits, stats.lookups))
+            .arg(hit_rate(stats.base_hits, stats.lookups));
+    if (stats.failed_spills > 0) {
+        text.append(QString("; %1 spills could not be written, so the budget was raised").arg(stats.failed_spills));
+    }
+    return text;
+}
+
 void scantools::index_files() {
-    emit console("indexing files..", true);
-    std::vector<QFuture<void>> v;
-    size_t number_of_files = 0;
-    for (size_t i = 0; i < files.size(); i++) {
-        if (index.count(files[i].path.toStdString()) > 0) {
+    /* a canceled walk has not seen the whole tree, so nothing can be removed */
+    size_t number_of_removed = 0;
+    const file_table &table = index.entries();
+    for (file_entry entry = 0; !scan_token.is_canceled() && entry < seen.size(); entry++) {
+        if (table.used(entry) && !seen[entry]) {
+            index.remove_file(entry);
+            number_of_removed++;
+        }
+    }
+    seen.clear();
+    emit console(QString("indexing files: %1 read, %2 unchanged, %3 removed, %4 duplicates, %5 MiB for %6 paths")
+                 .arg(number_of_read).arg(number_of_found - number_of_read).arg(number_of_removed)
+                 .arg(index.duplicates()).arg(table.memory() / 1048576.0, 0, 'f', 1).arg(table.size()), false);
+    tier_stats tiers = index.stats();
+    emit console(describe_tiers(tiers), true, tiers.failed_spills > 0 ? "orange" : "");
+    /* the saved index becomes the base, which the snapshots share instead of copying its postings */
+    if (save_index() && !index.load(index_file_name().toStdString())) {
+        emit console("saved index cannot be read back, searching the index in memory", true, "orange");
+    }
+    publish();
+    bool watching = watcher.start(QDir(main_directory).absolutePath().toStdString(),
+                                  [this] (directory_watcher::change_batch &&batch) {
+        {
+            std::lock_guard<std::mutex> guard(changes_lock);
+            changes.changed.insert(changes.changed.end(), batch.changed.begin(), batch.changed.end());
+            changes.removed.insert(changes.removed.end(), batch.removed.begin(), batch.removed.end());
+            changes.overflow |= batch.overflow;
+        }
+        QMetaObject::invokeMethod(this, "apply_changes", Qt::QueuedConnection);
+    });
+    if (!watching) {
+        emit console("changes of files will not be noticed", true, "orange");
+    }
+    scanning_state = END;
+}
+
+/*
+ * Runs on the thread of scantools, the only one which writes to the index.
+ * Removals are applied first, a removed path which is not a known file is a
+ * directory. Changed files which still exist are read by the indexing
+ * pipeline all together. If events were lost, the tree is walked again and
+ * compared with the index as at the start of a scan.
+ */
+void scantools::apply_changes() {
+    directory_watcher::change_batch batch;
+    {
+        std::lock_guard<std::mutex> guard(changes_lock);
+        std::swap(batch, changes);
+    }
+    if (batch.empty()) {
+        return;
+    }
+    std::vector<index_job> jobs;
+    size_t number_of_removed = 0;
+    /* the path of the last change, to tell which file it was if it is the only one */
+    std::string last;
+    auto forget = [&] (const std::string &path) {
+        if (!index.remove_file(path)) {
+            return false;
+        }
+        number_of_removed++;
+        last = path;
+        return true;
+    };
+    if (batch.overflow) {
+        std::mutex lock;
+        std::vector<bool> present(index.entries().end(), false);
+        directory_crawler crawler;
+        crawler.crawl(QDir(main_directory).absolutePath().toStdString(), [&] (crawled_file &&f) {
+            file_fingerprint fingerprint = {f.size, f.modified};
+            std::lock_guard<std::mutex> guard(lock);
+            file_entry entry = index.entry(f.path);
+            if (entry != file_table::NONE) {
+                present[entry] = true;
+            }
+            if (!index.is_unchanged(f.path, fingerprint)) {
+                jobs.push_back({std::move(f.path), fingerprint});
+            }
+        });
+        const file_table &table = index.entries();
+        for (file_entry entry = 0; entry < present.size(); entry++) {
+            if (table.used(entry) && !present[entry]) forget(table.path(entry));
+        }
+    } else {
+        std::vector<std::string> known;
+        for (const std::string &path : batch.removed) {
+            if (forget(path)) {
+                continue;
+            }
+            if (known.empty()) known = index.known_files();
+            std::string prefix = path + "/";
+            for (const std::string &k : known) {
+                if (k.compare(0, prefix.size(), prefix) == 0) forget(k);
+            }
+        }
+        for (const std::string &path : batch.changed) {
+            QFileInfo file_info(QString::fromStdString(path));
+            if (!file_info.isFile() || file_info.isSymLink()) {
+                forget(path);
+                continue;
+            }
+            file_fingerprint fingerprint = {file_info.size(), file_info.lastModified().toMSecsSinceEpoch()};
+            if (!index.is_unchanged(path, fingerprint)) {
+                jobs.push_back({path, fingerprint});
+            }
+        }
+    }
+    size_t number_of_changed = 0;
+    if (!jobs.empty()) {
+        folding_cost cost;
+        folding_cost *folding = case_folding ? &cost : nullptr;
+        indexing_pipeline pipeline([folding] (const mapped_file &file, trigram_set &trigrams,
+                                              std::vector<chunk_trigrams> &chunks) {
+            return read_trigrams(file, trigrams, chunks, nullptr, folding);
+        }, io_threads, cpu_threads);
+        std::thread feeder([&] {
+            for (index_job &job : jobs) {
+                pipeline.submit(std::move(job));
+            }
+            pipeline.close();
+        });
+        index_result result;
+        while (pipeline.next(result)) {
+            add_result(index, result);
+            number_of_changed++;
+            last = result.path;
+        }
+        feeder.join();
+    }
+    if (number_of_changed + number_of_removed > 0) {
+        publish();
+    }
+    if (number_of_changed + number_of_removed == 1) {
+        emit console(QString(number_of_changed == 1 ? "File was changed: " : "File was removed: ")
+                     .append(QString::fromStdString(last)), true, "pink");
+    } else if (number_of_changed + number_of_removed > 0) {
+        emit console(QString("%1 files were changed, %2 removed%3").arg(number_of_changed).arg(number_of_removed)
+                     .arg(batch.overflow ? " (events were lost, the tree was walked again)" : ""), true, "pink");
+    }
+}
+
+/*
+ * Reports every match which starts inside the chunk and not before from,
+ * matches do not overlap. Big chunks are searched by blocks overlapping by
+ * length - 1 bytes, so the search can be canceled between them.
+ */
+static void find_all_in_chunk(const substring_matcher &matcher, const mapped_file &file, const file_chunk &chunk,
+                              std::uint64_t &from, cancellation_token &token,
+                              const std::function<bool(std::uint64_t)> &on_match) {
+    size_t length = matcher.length();
+    size_t overlap = length > 0 ? length - 1 : 0;
+    size_t end = file.size();
+    if (chunk.size != file_chunk::TO_END_OF_FILE) {
+        end = std::min<std::uint64_t>(chunk.offset + chunk.size, file.size());
+    }
+    from = std::max<std::uint64_t>(from, std::min<std::uint64_t>(chunk.offset, file.size()));
+    while (from < end) {
+        if (!token.checkpoint()) {
+            return;
+        }
+        size_t limit = std::min<std::uint64_t>(from + VERIFY_BLOCK_SIZE, end);
+        size_t size = std::min<std::uint64_t>(limit - from + overlap, file.size() - from);
+        qint64 x = matcher.find(file.data() + from, size);
+        if (x == -1) {
+            from = limit;
             continue;
         }
-        index.insert({files[i].path.toStdString(), std::unique_ptr<std::set<std::string>>(new std::set<std::string>())}).second;
-        v.push_back(QtConcurrent::run([&] (const QString& s) {
-            auto g = index.find(s.toStdString());
+        if (!on_match(from + x)) {
+            return;
+        }
+        from += x + std::max<size_t>(length, 1);
+    }
+}
 
-            emit console(QString("indexing files (%1%) ..").arg((number_of_files + 1) * 100 / files.size()), false);
-            number_of_files++;
-            QFile file(s);
-            if (!file.exists() || !file.open(QIODevice::ReadOnly)) {
-                index.erase(g);
+/*
+ * The same for a case folded query: blocks of the chunk are folded and searched,
+ * matches are mapped back to the original bytes. A folded byte comes from at
+ * most three original ones, which bounds the overlap of the blocks; blocks
+ * start at characters.
+ */
+static void find_all_folded_in_chunk(const substring_matcher &matcher, const mapped_file &file,
+                                     const file_chunk &chunk, std::uint64_t &from, cancellation_token &token,
+                                     const std::function<bool(std::uint64_t, std::uint64_t)> &on_match) {
+    size_t length = matcher.length();
+    size_t overlap = 3 * length + 3;
+    size_t end = file.size();
+    if (chunk.size != file_chunk::TO_END_OF_FILE) {
+        end = std::min<std::uint64_t>(chunk.offset + chunk.size, file.size());
+    }
+    from = std::max<std::uint64_t>(from, std::min<std::uint64_t>(chunk.offset, file.size()));
+    while (from < end && is_continuation(file.data()[from])) {
+        from++;
+    }
+    folded_text folded;
+    while (from < end) {
+        if (!token.checkpoint()) {
+            return;
+        }
+        size_t limit = std::min<std::uint64_t>(from + BLOCK_SIZE, end);
+        while (limit < end && is_continuation(file.data()[limit])) {
+            limit++;
+        }
+        folded.fold(file.data() + from, std::min<std::uint64_t>(limit - from + overlap, file.size() - from), true);
+        const std::string &text = folded.text();
+        std::uint64_t next = limit;
+        for (size_t position = 0; position < text.size();) {
+            qint64 x = matcher.find(text.data() + position, text.size() - position);
+            if (x == -1) {
+                break;
+            }
+            size_t start = position + x;
+            std::uint64_t offset = from + folded.origin(start);
+            if (offset >= limit) {
+                break;
+            }
+            std::uint64_t stop = from + folded.origin(start + length);
+            if (!on_match(offset, stop - offset)) {
+                from = stop;
                 return;
             }
-            std::queue<char> symbols;
-            std::vector<char> buffer(BLOCK_SIZE);
-            std::uint32_t state = UTF8_ACCEPT;
-            while (!file.atEnd()) {
-                qint64 count_read = file.read(&buffer[0], BLOCK_SIZE);
-                if (count_read == -1 || validate_utf8(&state, &buffer[0], buffer.size()) == UTF8_REJECT) {
-                    file.close();
-                    index.erase(g);
+            next = std::max(next, stop);
+            position = start + std::max<size_t>(length, 1);
+        }
+        from = next;
+    }
+}
+
+/*
+ * Reports the matches of a regular expression in the whole file. Blocks of
+ * about VERIFY_BLOCK_SIZE bytes end with a line, so the search can be canceled
+ * between them; only lines which have a match are searched for positions.
+ */
+static void find_all_regex(regex_matcher &matcher, const mapped_file &file, cancellation_token &token,
+                           const std::function<bool(std::uint64_t, std::uint64_t)> &on_match) {
+    char const *data = file.data();
+    std::vector<std::pair<size_t, size_t>> matches;
+    for (size_t from = 0; from < file.size();) {
+        if (!token.checkpoint()) {
+            return;
+        }
+        size_t limit = std::min(from + VERIFY_BLOCK_SIZE, file.size());
+        char const *newline = static_cast<char const *>(std::memchr(data + limit - 1, '\n', file.size() - limit + 1));
+        limit = newline != nullptr ? newline - data + 1 : file.size();
+        for (size_t position = from; position < limit;) {
+            qint64 x = matcher.find_line(data + position, limit - position);
+            if (x == -1) {
+                break;
+            }
+            size_t line = position + x;
+            char const *end = static_cast<char const *>(std::memchr(data + line, '\n', limit - line));
+            size_t line_end = end != nullptr ? end - data : limit;
+            matcher.find_in_line(data + line, line_end - line, matches);
+            for (const auto &match : matches) {
+                if (!on_match(line + match.first, match.second)) {
                     return;
                 }
-                for (size_t k = 0; k < buffer.size(); k++) {
-                    symbols.push(buffer.at(k));
-                    if (symbols.size() < GRAM_SIZE) continue;
-                    if (symbols.size() > GRAM_SIZE) symbols.pop();
-                    std::string ngram = "";
-                    for (size_t j = 0; j < GRAM_SIZE; j++) {
-                        ngram += symbols.front();
-                        symbols.push(symbols.front());
-                        symbols.pop();
-                    }
-                    g->second->insert(ngram);
-                }
-            }
-            file.close();
-            if (g->second->size() > CHECK_SIZE) {
-                index.erase(g);
             }
+            position = line_end + 1;
+        }
+        from = limit;
+    }
+}
+
+/*
+ * Collects (offset, pattern) of every occurrence which starts inside the chunk,
+ * sorted by offset. The chunk is read once, extended by the longest pattern.
+ * False if the search was canceled.
+ */
+static bool find_all_patterns(const aho_corasick &automaton, size_t longest, const mapped_file &file,
+                              const file_chunk &chunk, cancellation_token &token,
+                              std::vector<std::pair<std::uint64_t, size_t>> &hits) {
+    hits.clear();
+    size_t begin = std::min<std::uint64_t>(chunk.offset, file.size());
+    size_t end = file.size();
+    if (chunk.size != file_chunk::TO_END_OF_FILE) {
+        end = std::min<std::uint64_t>(chunk.offset + chunk.size, file.size());
+    }
+    size_t extent = std::min(end + longest - 1, file.size());
+    std::uint32_t state = 0;
+    for (size_t block = begin; block < extent; block += VERIFY_BLOCK_SIZE) {
+        if (!token.checkpoint()) {
+            return false;
+        }
+        size_t size = std::min(VERIFY_BLOCK_SIZE, extent - block);
+        automaton.scan(state, file.data() + block, size, block, [&] (size_t pattern, std::uint64_t offset) {
+            if (offset >= begin && offset < end) hits.push_back({offset, pattern});
+            return true;
+        });
+    }
+    std::sort(hits.begin(), hits.end());
+    return true;
+}
+
+/*
+ * Reports the approximate matches which start inside the chunk and not before
+ * from. Blocks are scanned one by one for cancellation; a match of a block
+ * may end up to length + k bytes after it.
+ */
+static void find_all_fuzzy_in_chunk(const fuzzy_matcher &matcher, const mapped_file &file, const file_chunk &chunk,
+                                    std::uint64_t &from, cancellation_token &token,
+                                    const std::function<bool(std::uint64_t, std::uint64_t, size_t)> &on_match) {
+    size_t end = file.size();
+    if (chunk.size != file_chunk::TO_END_OF_FILE) {
+        end = std::min<std::uint64_t>(chunk.offset + chunk.size, file.size());
+    }
+    bool more = true;
+    for (size_t block = std::max<std::uint64_t>(from, chunk.offset); more && block < end; block += VERIFY_BLOCK_SIZE) {
+        if (!token.checkpoint()) {
             return;
-        }, std::cref(files[i].path)));
+        }
+        size_t limit = std::min(block + VERIFY_BLOCK_SIZE, end);
+        matcher.find_all(file.data(), file.size(), std::max<std::uint64_t>(block, from), limit, from,
+                         [&] (std::uint64_t offset, std::uint64_t length, size_t distance) {
+            return more = on_match(offset, length, distance);
+        });
     }
-    for (auto it = v.begin(); it != v.end(); it++) {
-        it->waitForFinished();
+}
+
+/* e.g. plan: 2 of 9 grams ("xyz" 3, "abc" 120), 1.4 candidates estimated, 2 found, 5 matches */
+static QString describe_plan(const query_plan &plan, size_t matched) {
+    QString used;
+    for (size_t i = 0; i < plan.used; i++) {
+        trigram t = plan.trigrams[i];
+        int length = static_cast<int>(gram_length(t));
+        char text[GRAM_SIZE];
+        for (int k = 0; k < length; k++) {
+            text[k] = static_cast<char>(t >> (8 * (length - 1 - k)));
+        }
+        if (i > 0) used.append(", ");
+        used.append(QString("\"%1\" %2").arg(QString::fromUtf8(text, length)).arg(plan.frequencies[i]));
     }
-    emit console("indexing files..", false);
-    for (auto it = index.begin(); it != index.end(); it++) {
-        indexed.insert(it->first);
-        file_watcher.addPath(QString::fromStdString((*it).first));
+    return QString("plan: %1 of %2 grams (%3), %4 candidates estimated, %5 found, %6 matches")
+            .arg(plan.used).arg(plan.trigrams.size()).arg(used).arg(plan.estimated, 0, 'f', 1)
+            .arg(plan.candidates).arg(matched);
+}
+
+void scantools::show_match(const search_match &match) {
+    emit add_item(QString::fromStdString(match.path), QString::number(match.line),
+                  QString::number(match.column), QString::number(match.offset),
+                  QString::fromUtf8(match.snippet.data(), static_cast<int>(match.snippet.size())));
+}
+
+/*
+ * Matches found by the verifying threads, taken by the caller of find_substring
+ * as they come. A match in a file which has copies is reported for every copy.
+ */
+struct scantools::match_stream {
+    std::mutex lock;
+    std::vector<search_match> matches;
+    std::vector<search_match> *collected;
+    std::atomic<size_t> number_of_matches;
+    size_t max_results;
+    cancellation_token &token;
+    /* verified path -> paths of its copies, filled before verifying starts */
+    std::unordered_map<std::string, std::vector<std::string>> copies;
+
+    match_stream(size_t max_results, cancellation_token &token, std::vector<search_match> *collected)
+            : collected(collected), number_of_matches(0), max_results(max_results), token(token) {}
+
+    bool limited() const { return max_results > 0 && number_of_matches >= max_results; }
+
+    /* false once max_results is reached, then the rest of the search is canceled */
+    bool push(search_match &&match) {
+        auto it = copies.find(match.path);
+        if (it == copies.end()) {
+            return add(std::move(match));
+        }
+        for (const std::string &path : it->second) {
+            search_match copy = match;
+            copy.path = path;
+            if (!add(std::move(copy))) {
+                return false;
+            }
+        }
+        return add(std::move(match));
     }
-    connect(&file_watcher, &QFileSystemWatcher::fileChanged, this, &scantools::check_file);
-    scanning_state = END;
+
+    bool add(search_match &&match) {
+        size_t number = ++number_of_matches;
+        if (max_results > 0 && number > max_results) {
+            number_of_matches = max_results;
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (collected != nullptr) collected->push_back(match);
+            matches.push_back(std::move(match));
+        }
+        if (number == max_results) {
+            token.cancel();
+            return false;
+        }
+        return true;
+    }
+
+    void take(std::vector<search_match> &out) {
+        std::lock_guard<std::mutex> guard(lock);
+        out.swap(matches);
+    }
+};
+
+/*
+ * Verifies candidate files on the thread pool, the chunks of a file are
+ * verified together in one task. Matches are shown as soon as they are
+ * found, polling also keeps the event loop of the caller alive, so the
+ * search can be canceled.
+ */
+size_t scantools::stream_matches(const trigram_index &snapshot, const std::vector<file_id> &ids, size_t max_results,
+                                 const file_verifier &verify, std::vector<search_match> *collected) {
+    match_stream stream(max_results, search_token, collected);
+    /* copies of a file are reported with its matches and never read */
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (i > 0 && snapshot.owner(ids[i]) == snapshot.owner(ids[i - 1])) {
+            continue;
+        }
+        std::vector<file_entry> copies = snapshot.copies(snapshot.owner(ids[i]));
+        if (!copies.empty()) {
+            std::vector<std::string> &paths = stream.copies[snapshot.path(ids[i])];
+            for (file_entry copy : copies) {
+                paths.push_back(snapshot.entries().path(copy));
+            }
+        }
+    }
+    std::vector<QFuture<void>> v;
+    for (size_t i = 0, j; i < ids.size(); i = j) {
+        file_entry owner = snapshot.owner(ids[i]);
+        std::vector<file_chunk> chunks;
+        for (j = i; j < ids.size() && snapshot.owner(ids[j]) == owner; j++) {
+            chunks.push_back(snapshot.chunk(ids[j]));
+        }
+        v.push_back(QtConcurrent::run([&stream, &verify] (const std::string &path, const std::vector<file_chunk> &chunks) {
+            mapped_file file(path);
+            if (file.is_open()) {
+                verify(path, file, chunks, stream);
+            }
+        }, snapshot.path(ids[i]), std::move(chunks)));
+    }
+    std::vector<search_match> ready;
+    for (size_t finished = 0;;) {
+        while (finished < v.size() && v[finished].isFinished()) {
+            finished++;
+        }
+        stream.take(ready);
+        for (const search_match &match : ready) {
+            show_match(match);
+        }
+        ready.clear();
+        emit update_items();
+        if (finished == v.size()) {
+            break;
+        }
+        QThread::msleep(10);
+    }
+    if (stream.limited()) {
+        emit console(QString("search stopped after %1 matches").arg(max_results), true, "orange");
+    } else if (search_token.is_canceled()) {
+        emit console("search canceled", true, "red");
+    }
+    return stream.number_of_matches;
 }
 
-void scantools::check_file(const QString &path) {
-    if (index.count(path.toStdString()) == 0) {
+/*
+ * A match which starts in a chunk is only guaranteed to have the trigrams of
+ * its first CHUNK_OVERLAP + 1 bytes there, so the rest of the query is left
+ * to the verification. Only matching chunks of a file are read.
+ * A case-insensitive query is folded and looked up among the folded trigrams,
+ * its prefix is shorter as folding may shrink the text up to three times.
+ * While typing, a query usually extends a cached one: then only files which
+ * matched it, or changed after it, can match. Matches of the very same query
+ * are reused for the files which did not change.
+ */
+void scantools::find_substring(QString substring, size_t max_results, bool ignore_case) {
+    emit clear_items();
+    search_token.reset();
+    std::shared_ptr<const trigram_index> current = snapshot();
+    std::string s = substring.toStdString();
+    if (s.empty()) {
         return;
     }
-    auto g = index.find(path.toStdString());
-    g->second->clear();
-    QFile file(path);
-    if (!file.exists() || !file.open(QIODevice::ReadOnly)) {
-        index.erase(g);
-        indexed.erase(path.toStdString());
-        return;
+    std::string pattern = ignore_case ? fold_utf8(s) : s;
+    std::vector<trigram> ngrams;
+    if (!ignore_case) {
+        ngrams = query_trigrams(s.data(), std::min(s.length(), CHUNK_OVERLAP + 1));
+    } else if (case_folding) {
+        ngrams = query_trigrams(pattern.data(), std::min(pattern.length(), CHUNK_OVERLAP / 3));
+        for (trigram &t : ngrams) {
+            t |= FOLDED_TAG;
+        }
+    } else {
+        emit console("the index has no folded trigrams, every file is verified", true, "orange");
     }
-    std::queue<char> symbols;
-    std::vector<char> buffer(BLOCK_SIZE);
-    std::uint32_t state = UTF8_ACCEPT;
-    while (!file.atEnd()) {
-        qint64 count_read = file.read(&buffer[0], BLOCK_SIZE);
-        if (count_read == -1 || validate_utf8(&state, &buffer[0], buffer.size()) == UTF8_REJECT) {
-            file.close();
-            index.erase(g);
-            indexed.erase(path.toStdString());
-            return;
+    substring_matcher matcher(pattern);
+    query_plan plan;
+    std::vector<file_id> ids = current->candidates(ngrams, &plan);
+
+    std::vector<search_match> matches;
+    const cached_query *base = cache.find(pattern, ignore_case, current->layout_version());
+    if (base != nullptr) {
+        bool same = base->pattern == pattern;
+        size_t k = 0;
+        for (file_id id : ids) {
+            if (id >= base->horizon || (!same && base->matched_files.count(current->owner(id)) > 0)) ids[k++] = id;
         }
-        for (size_t k = 0; k < buffer.size(); k++) {
-            symbols.push(buffer.at(k));
-            if (symbols.size() < GRAM_SIZE) continue;
-            if (symbols.size() > GRAM_SIZE) symbols.pop();
-            std::string ngram = "";
-            for (size_t j = 0; j < GRAM_SIZE; j++) {
-                ngram += symbols.front();
-                symbols.push(symbols.front());
-                symbols.pop();
+        ids.resize(k);
+        for (size_t i = 0; same && i < base->matches.size() && (max_results == 0 || i < max_results); i++) {
+            if (current->indexed_before(base->matches[i].path, base->horizon)) {
+                matches.push_back(base->matches[i]);
+                show_match(matches.back());
             }
-            g->second->insert(ngram);
         }
     }
-    file.close();
+    size_t reused = matches.size();
+    bool complete = max_results == 0 || reused < max_results;
+    if (!complete) {
+        ids.clear();
+    }
+    file_id horizon = current->next_id();
+    size_t found = stream_matches(*current, ids, max_results == 0 ? 0 : max_results - reused, [&] (const std::string &path,
+                                  const mapped_file &file, const std::vector<file_chunk> &chunks, match_stream &stream) {
+        std::uint64_t from = 0;
+        for (const file_chunk &chunk : chunks) {
+            match_locator locator(file.data(), file.size(), chunk.offset, chunk.line, chunk.column);
+            bool more = true;
+            auto report = [&] (std::uint64_t offset, std::uint64_t length) {
+                return more = stream.push(locator.locate(path, offset, length));
+            };
+            if (ignore_case) {
+                find_all_folded_in_chunk(matcher, file, chunk, from, search_token, report);
+            } else {
+                find_all_in_chunk(matcher, file, chunk, from, search_token, [&] (std::uint64_t offset) {
+                    return report(offset, s.length());
+                });
+            }
+            if (!more) {
+                return;
+            }
+        }
+    }, &matches);
+    if (complete && !search_token.is_canceled()) {
+        cache.put(cached_query(pattern, ignore_case, *current, horizon, std::move(matches)));
+    }
+    emit console(describe_plan(plan, reused + found), true);
+    tier_stats tiers = current->stats();
+    emit console(describe_tiers(tiers), true, tiers.failed_spills > 0 ? "orange" : "");
+}
 
-    if (g->second->size() <= CHECK_SIZE) {
-        console(QString("File was changed: ").append(path), true, "pink");
-    } else {
-        console(QString("File was removed: ").append(path), true, "pink");
-        index.erase(g);
-        indexed.erase(path.toStdString());
-        file_watcher.removePath(path);
+/*
+ * The expression is turned into a boolean query over trigrams which picks
+ * the candidate files; a match may be longer than a chunk overlap, so the
+ * query is evaluated over whole files and they are verified whole.
+ */
+void scantools::find_regex(QString pattern, size_t max_results, bool ignore_case) {
+    emit clear_items();
+    search_token.reset();
+    std::shared_ptr<const trigram_index> current = snapshot();
+    std::string s = pattern.toStdString();
+    if (s.empty()) {
+        return;
+    }
+    regex_node root;
+    std::string error;
+    if (!parse_regex(s, ignore_case, root, error)) {
+        emit console(QString("invalid regular expression: ").append(QString::fromStdString(error)), true, "red");
+        return;
+    }
+    regex_program program(root);
+    if (program.too_big()) {
+        emit console("regular expression is too big", true, "red");
+        return;
     }
+    trigram_query query = regex_trigram_query(root);
+    std::vector<file_id> ids = files_matching(query, *current);
+    /* a matcher keeps its DFA states from file to file, idle ones are lent to the verifying threads */
+    std::mutex matchers_lock;
+    std::vector<std::unique_ptr<regex_matcher>> matchers;
+    size_t found = stream_matches(*current, ids, max_results, [&] (const std::string &path, const mapped_file &file,
+                                                         const std::vector<file_chunk> &, match_stream &stream) {
+        std::unique_ptr<regex_matcher> matcher;
+        {
+            std::lock_guard<std::mutex> guard(matchers_lock);
+            if (!matchers.empty()) {
+                matcher = std::move(matchers.back());
+                matchers.pop_back();
+            }
+        }
+        if (matcher == nullptr) {
+            matcher.reset(new regex_matcher(program));
+        }
+        match_locator locator(file.data(), file.size());
+        find_all_regex(*matcher, file, search_token, [&] (std::uint64_t offset, std::uint64_t length) {
+            return stream.push(locator.locate(path, offset, length));
+        });
+        std::lock_guard<std::mutex> guard(matchers_lock);
+        matchers.push_back(std::move(matcher));
+    });
+    QString description = QString::fromStdString(query.describe());
+    if (description.size() > 200) {
+        description = description.left(200).append("..");
+    }
+    emit console(QString("query: %1, %2 of %3 files, %4 matches").arg(description).arg(ids.size())
+                 .arg(current->size()).arg(found), true);
 }
 
-void scantools::find_substring(QString substring) {
+/*
+ * Looks for many literal patterns at once: the candidate chunks of all of them
+ * are united and each one is read once by an Aho-Corasick automaton instead of
+ * once per pattern. Hits are counted per pattern.
+ */
+void scantools::find_substrings(const QStringList &patterns, size_t max_results) {
     emit clear_items();
-    std::string s = substring.toStdString();
-    std::vector<std::string> ngrams;
-    if (s.length() >= GRAM_SIZE) {
-        for (size_t i = 0; i < s.length() - GRAM_SIZE + 1; i++) {
-            ngrams.push_back(s.substr(i, GRAM_SIZE));
-        }
-    }
-    std::vector<QFuture<std::pair<std::string, std::pair<bool, qint64>>>> v;
-    for (auto it = index.begin(); it != index.end(); it++) {
-        v.push_back(QtConcurrent::run([&] (const std::string& s,  const std::unique_ptr<std::set<std::string>> &p) {
-                        bool f = true;
-                        for (size_t i = 0; i < ngrams.size(); i++) {
-                            if (p->count(ngrams[i]) == 0) {
-                                f = false;
-                                break;
-                            }
-                        }
-                        if (f) {
-                            QFile file(QString::fromStdString(s));
-                            file.open(QIODevice::ReadOnly);
-                            std::vector<char> buffer(BLOCK_SIZE);
-
-                            size_t block_size = BLOCK_SIZE, substring_size = 0;
-                            while (!file.atEnd()) {
-                                qint64 count_read = file.read(&buffer[substring_size], block_size);
-                                if (count_read == -1 ) break;
-                                if (block_size == BLOCK_SIZE) {
-                                    block_size -= substring.length();
-                                    substring_size += substring.length();
-                                }
-                                std::string str(buffer.begin(), buffer.end());
-                                qint64 x = KMPAlgorithm(str, substring.toStdString());
-                                if (x != -1) {
-                                    return std::make_pair(s, std::make_pair(true, x));
-                                }
-                                if (!file.atEnd()) {
-                                    for (size_t i = 0; i < substring_size; i++) {
-                                        buffer[i] = buffer[block_size + i];
-                                    }
-                                }
-                            }
-                        }
-                        return std::make_pair(s, std::make_pair(false, 0ll));
-        }, std::cref(it->first), std::cref(it->second)));
-    }
-    for (auto it = v.begin(); it != v.end(); it++) {
-        auto result = it->result();
-        if (result.second.first) {
-            emit add_item(QString::fromStdString(result.first), QString::number(result.second.second));
-        }
-    }
-    emit update_items();
+    search_token.reset();
+    std::shared_ptr<const trigram_index> current = snapshot();
+    std::vector<std::string> unique;
+    std::unordered_set<std::string> seen;
+    for (const QString &pattern : patterns) {
+        std::string s = pattern.toStdString();
+        if (!s.empty() && seen.insert(s).second) {
+            unique.push_back(s);
+        }
+    }
+    if (unique.empty()) {
+        return;
+    }
+    std::vector<file_id> ids;
+    size_t longest = 0;
+    for (const std::string &s : unique) {
+        std::vector<file_id> candidates = current->candidates(query_trigrams(s.data(),
+                                                                          std::min(s.length(), CHUNK_OVERLAP + 1)));
+        ids.insert(ids.end(), candidates.begin(), candidates.end());
+        longest = std::max(longest, s.length());
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    aho_corasick automaton(unique);
+    std::vector<std::atomic<size_t>> hits(unique.size());
+    size_t found = stream_matches(*current, ids, max_results, [&] (const std::string &path, const mapped_file &file,
+                                                         const std::vector<file_chunk> &chunks, match_stream &stream) {
+        std::vector<std::pair<std::uint64_t, size_t>> chunk_hits;
+        for (const file_chunk &chunk : chunks) {
+            if (!find_all_patterns(automaton, longest, file, chunk, search_token, chunk_hits)) {
+                return;
+            }
+            match_locator locator(file.data(), file.size(), chunk.offset, chunk.line, chunk.column);
+            for (const auto &hit : chunk_hits) {
+                hits[hit.second]++;
+                if (!stream.push(locator.locate(path, hit.first, unique[hit.second].length()))) {
+                    return;
+                }
+            }
+        }
+    });
+    size_t matched = 0;
+    for (size_t i = 0; i < unique.size(); i++) {
+        if (hits[i] == 0) continue;
+        if (++matched <= 50) {
+            emit console(QString("\"%1\": %2 matches").arg(QString::fromStdString(unique[i])).arg(hits[i].load()), true);
+        }
+    }
+    emit console(QString("%1 of %2 patterns found, %3 candidate chunks, %4 matches")
+                 .arg(matched).arg(unique.size()).arg(ids.size()).arg(found), true);
+}
+
+/*
+ * A text within k edits of a pattern of m bytes keeps at least m - q + 1 - qk
+ * of its q-grams, as an edit breaks at most q of them (q-gram lemma); the
+ * chunks which have that many are verified by the bit-parallel matcher.
+ * Short patterns or many edits give no bound, then every chunk is verified.
+ */
+void scantools::find_fuzzy(QString pattern, size_t edits, size_t max_results) {
+    emit clear_items();
+    search_token.reset();
+    std::shared_ptr<const trigram_index> current = snapshot();
+    std::string s = pattern.toStdString();
+    if (s.empty()) {
+        return;
+    }
+    if (s.length() > fuzzy_matcher::MAX_LENGTH) {
+        emit console(QString("approximate search takes at most %1 bytes").arg(fuzzy_matcher::MAX_LENGTH), true, "red");
+        return;
+    }
+    if (edits >= s.length()) {
+        emit console("too many edits, every text would match", true, "red");
+        return;
+    }
+    std::vector<trigram> ngrams = query_grams<GRAM_SIZE>(s.data(), s.length());
+    size_t threshold = s.length() + 1 >= GRAM_SIZE * (edits + 1) ? s.length() + 1 - GRAM_SIZE * (edits + 1) : 0;
+    std::vector<file_id> ids = current->candidates_sharing(ngrams, threshold);
+    fuzzy_matcher matcher(s, edits);
+    size_t found = stream_matches(*current, ids, max_results, [&] (const std::string &path, const mapped_file &file,
+                                                         const std::vector<file_chunk> &chunks, match_stream &stream) {
+        std::uint64_t from = 0;
+        for (const file_chunk &chunk : chunks) {
+            match_locator locator(file.data(), file.size(), chunk.offset, chunk.line, chunk.column);
+            bool more = true;
+            find_all_fuzzy_in_chunk(matcher, file, chunk, from, search_token,
+                                    [&] (std::uint64_t offset, std::uint64_t length, size_t) {
+                return more = stream.push(locator.locate(path, offset, length));
+            });
+            if (!more) {
+                return;
+            }
+        }
+    });
+    emit console(QString("fuzzy: at most %1 edits, %2 of %3 trigrams required, %4 candidates, %5 matches")
+                 .arg(edits).arg(threshold).arg(ngrams.size()).arg(ids.size()).arg(found), true);
 }
 
 void scantools::open_directory(QString path) {
@@ -259,8 +1060,10 @@ void scantools::open_directory(QString path) {
         if (!QDir::current().isRoot()) {
             emit add_item("..");
         }
+        std::shared_ptr<const trigram_index> current = snapshot();
+        std::uint32_t directory = current->entries().find_directory(QDir::currentPath().toStdString());
         for (QFileInfo f: list) {
-            if (index.count(f.absoluteFilePath().toStdString()) > 0) {
+            if (directory != file_table::NONE && current->contains(current->entries().find(directory, f.fileName().toStdString()))) {
                 emit add_item(f.fileName(), (f.isDir()) ? "directory" : (f.isFile()) ? "file" : "", (f.isFile()) ? QString::number(f.size()) : "", f.absoluteFilePath(), f.lastModified().toString(FORMAT), &pure_blue_brush);
             } else {
                 emit add_item(f.fileName(), (f.isDir()) ? "directory" : (f.isFile()) ? "file" : "", (f.isFile()) ? QString::number(f.size()) : "", f.absoluteFilePath(), f.lastModified().toString(FORMAT));
@@ -4,6 +4,7 @@
 #include <QFileInfo>
 #include <QDebug>
 #include <QString>
+#include <QStringList>
 #include <queue>
 #include <vector>
 #include <set>
@@ -11,9 +12,16 @@
 #include <QTreeWidget>
 #include <QDateTime>
 #include <QDir>
-#include <QFileSystemWatcher>
 
 #include <memory>
+#include <mutex>
+#include <functional>
+
+#include "trigram_index.h"
+#include "directory_crawler.h"
+#include "directory_watcher.h"
+#include "cancellation.hpp"
+#include "query_cache.h"
 
 static QColor red = QColor(255, 0, 0);
 static QColor pure_blue = QColor(0, 136, 255);
@@ -22,31 +30,6 @@ static QBrush red_brush = QBrush(red);
 static QBrush pure_blue_brush = QBrush(pure_blue);
 static QBrush black_brush = QBrush(black);
 
-struct file {
-    QString name;
-    QString path;
-    long long size;
-    QDateTime date;
-
-    bool skip;
-    bool duplicated;
-    size_t first;
-    QString hash;
-
-    file(QFileInfo &file_info) {
-        name = file_info.fileName();
-        path = file_info.absoluteFilePath();
-        size = file_info.size();
-        date = file_info.lastModified();
-        skip = !file_info.isReadable();
-        duplicated = false;
-        hash = "";
-    }
-    bool compare(file &another) {
-        return size == another.size && hash == another.hash;
-    }
-};
-
 class scantools : public QObject {
     Q_OBJECT
 
@@ -65,37 +48,61 @@ public slots:
     void start();
     void end();
 
-    void check_file(const QString &path);
+    /* takes the changes gathered by the watcher and updates the index */
+    void apply_changes();
 
 private:
     /* we can use it in any part of code */
     bool mode;
+    bool case_folding;
+    /* megabytes of posting lists kept in memory while indexing, 0 for no limit */
+    size_t memory_budget;
     size_t result;
     QString main_directory;
-    enum {SCAN_DIRS, INDEX_FILES, WATCH_FILES, END} scanning_state;
+    enum {LOAD_INDEX, SCAN_DIRS, INDEX_FILES, WATCH_FILES, END} scanning_state;
     enum {PREPARED, SCANNING, PAUSED, CANCELED, FINISHED} main_state;
 
-    /* we can use it only in while-switch block in start */
-    std::vector<file> files;
-    std::queue<QString> dirs;
-
-    QFileSystemWatcher file_watcher;
-    std::map<std::string, std::unique_ptr<std::set<std::string>>> index;
-
-    std::set<std::string> indexed;
+    /* entries found by the walk, we can use it only in while-switch block in start */
+    std::vector<bool> seen;
+    size_t number_of_found;
+    size_t number_of_read;
+    size_t io_threads;
+    size_t cpu_threads;
+
+    directory_watcher watcher;
+    /* batches of the watcher which are not applied yet */
+    std::mutex changes_lock;
+    directory_watcher::change_batch changes;
+    /* written by the scan thread only */
+    trigram_index index;
+    /* read by searches, replaced as a whole after every change of the index */
+    std::shared_ptr<const trigram_index> published;
+    cancellation_token scan_token;
+    cancellation_token search_token;
+    query_cache cache;
 
     /* parts of scanning */
+    void load_index();
     void scan_directories();
     void sort_by_size();
-    void calculate_hashes(size_t, size_t);
-    void sort_by_hash(size_t);
-    void group_duplicates(size_t, size_t);
     void sort_by_name(size_t);
     void show_results(size_t i0, size_t j0);
 
     void do_smth();
     void index_files();
 
+    /* verifies candidates */
+    struct match_stream;
+    void show_match(const search_match &match);
+    typedef std::function<void(const std::string &, const mapped_file &, const std::vector<file_chunk> &,
+                               match_stream &)> file_verifier;
+    size_t stream_matches(const trigram_index &snapshot, const std::vector<file_id> &ids, size_t max_results,
+                          const file_verifier &verify, std::vector<search_match> *collected = nullptr);
+    std::shared_ptr<const trigram_index> snapshot() const { return std::atomic_load(&published); }
+    void publish();
+    bool save_index();
+    QString index_file_name();
+
     /* service */
     void check(size_t i = 0, size_t j = 0);
     void clear();
@@ -108,14 +115,28 @@ public:
         end();
     }
 
-    /* reserved methods */
-    void pause() {  }
-    void cancel() {  }
+    /* controlling methods, may be called from any thread */
+    void pause();
+    void resume();
+    void cancel();
 
     /* changing methods */
     void clean();
-
-    void find_substring(QString substring);
+    void set_threads(size_t io, size_t cpu) {
+        io_threads = io;
+        cpu_threads = cpu;
+    }
+    /* whether scanning also indexes case folded trigrams, takes effect with the next scan */
+    void set_case_folding(bool enabled) { case_folding = enabled; }
+    /* takes effect with the next scan */
+    void set_memory_budget(size_t megabytes) { memory_budget = megabytes; }
+
+    /* max_results = 0 means no limit */
+    void find_substring(QString substring, size_t max_results = 0, bool ignore_case = false);
+    void find_regex(QString pattern, size_t max_results = 0, bool ignore_case = false);
+    void find_substrings(const QStringList &patterns, size_t max_results = 0);
+    /* matches within edits insertions, deletions or substitutions of bytes */
+    void find_fuzzy(QString pattern, size_t edits, size_t max_results = 0);
     void open_directory(QString path = QDir::currentPath());
 
     /* describing methods */
@@ -0,0 +1,137 @@
+#ifndef SHARED_ARRAY_HPP
+#define SHARED_ARRAY_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/*
+ * Array kept in blocks of BLOCK_SIZE elements which copies share. Copying it
+ * copies the pointers to the blocks; the first change of a block after that
+ * copies the block, in whichever array is changed. A copy taken after a few
+ * changes thus costs a pointer per block and the blocks which were changed.
+ * Elements are only changed through set() and edit(), reading never copies.
+ */
+template <typename T, unsigned BLOCK_BITS = 12>
+class shared_array {
+public:
+    static const std::size_t BLOCK_SIZE = std::size_t(1) << BLOCK_BITS;
+
+private:
+    /* whole blocks are allocated, elements past the end are value initialized */
+    std::vector<std::shared_ptr<T>> blocks;
+    /*
+     * Blocks which no other array has seen, they are changed in place. Copying
+     * clears the flags of the original as well; a copy has none of them set,
+     * so copying it again from several threads only reads them.
+     */
+    mutable std::vector<bool> owned;
+    std::size_t count = 0;
+
+    static std::shared_ptr<T> new_block() {
+        return std::shared_ptr<T>(new T[BLOCK_SIZE](), std::default_delete<T[]>());
+    }
+
+    T *writable(std::size_t b) {
+        if (!owned[b]) {
+            std::shared_ptr<T> copy = new_block();
+            std::copy(blocks[b].get(), blocks[b].get() + BLOCK_SIZE, copy.get());
+            blocks[b] = std::move(copy);
+            owned[b] = true;
+        }
+        return blocks[b].get();
+    }
+
+public:
+    shared_array() = default;
+    shared_array(const shared_array &another)
+            : blocks(another.blocks), owned(another.owned.size(), false), count(another.count) {
+        for (std::size_t b = 0; b < another.owned.size(); b++) {
+            if (another.owned[b]) another.owned[b] = false;
+        }
+    }
+    shared_array(shared_array &&another) noexcept
+            : blocks(std::move(another.blocks)), owned(std::move(another.owned)), count(another.count) {
+        another.clear();
+    }
+    shared_array &operator=(const shared_array &another) {
+        if (this != &another) *this = shared_array(another);
+        return *this;
+    }
+    shared_array &operator=(shared_array &&another) noexcept {
+        swap(another);
+        another.clear();
+        return *this;
+    }
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T &operator[](std::size_t i) const { return blocks[i >> BLOCK_BITS].get()[i & (BLOCK_SIZE - 1)]; }
+    const T &back() const { return (*this)[count - 1]; }
+    T &edit(std::size_t i) { return writable(i >> BLOCK_BITS)[i & (BLOCK_SIZE - 1)]; }
+    /* values are taken by copy, they may be elements of a block which is replaced */
+    void set(std::size_t i, T value) { edit(i) = std::move(value); }
+    /* the elements from i to the end of its block are contiguous */
+    const T *data_at(std::size_t i) const { return blocks[i >> BLOCK_BITS].get() + (i & (BLOCK_SIZE - 1)); }
+
+    void push_back(T value) {
+        if ((count & (BLOCK_SIZE - 1)) == 0) {
+            blocks.push_back(new_block());
+            owned.push_back(true);
+        }
+        set(count++, value);
+    }
+
+    void resize(std::size_t size, T value = T()) {
+        while (count > size) {
+            std::size_t b = (count - 1) >> BLOCK_BITS;
+            std::size_t first = b << BLOCK_BITS;
+            if (size <= first) {
+                blocks.pop_back();
+                owned.pop_back();
+                count = first;
+            } else {
+                /* the elements past the end are value initialized again, as in a new block */
+                T *elements = writable(b);
+                std::fill(elements + (size - first), elements + (count - first), T());
+                count = size;
+            }
+        }
+        while (count < size) {
+            if ((count & (BLOCK_SIZE - 1)) == 0) {
+                blocks.push_back(new_block());
+                owned.push_back(true);
+            }
+            std::size_t b = blocks.size() - 1;
+            std::size_t filled = std::min(size, (b + 1) << BLOCK_BITS);
+            T *elements = writable(b);
+            std::fill(elements + (count - (b << BLOCK_BITS)), elements + (filled - (b << BLOCK_BITS)), value);
+            count = filled;
+        }
+    }
+
+    void assign(std::size_t size, T value) {
+        clear();
+        resize(size, value);
+    }
+
+    void clear() {
+        blocks.clear();
+        owned.clear();
+        count = 0;
+    }
+
+    void swap(shared_array &another) {
+        blocks.swap(another.blocks);
+        owned.swap(another.owned);
+        std::swap(count, another.count);
+    }
+
+    /* bytes of the blocks, shared ones included */
+    std::size_t memory() const {
+        return blocks.capacity() * sizeof(std::shared_ptr<T>) + blocks.size() * BLOCK_SIZE * sizeof(T);
+    }
+};
+
+#endif // SHARED_ARRAY_HPP
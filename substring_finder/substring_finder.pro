@@ -22,15 +22,60 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# The throughput of the vectorized kernels is measured by benchmarks/benchmarks.pro.
+
+# Length of the indexed grams, 3 by default; 2 and 4 are there to compare them.
+#DEFINES += INDEX_GRAM_SIZE=4
+
 
 SOURCES += \
         main.cpp \
         mainwindow.cpp \
-    scantools.cpp
+    scantools.cpp \
+    trigram_index.cpp \
+    file_table.cpp \
+    trigram_extractor.cpp \
+    substring_matcher.cpp \
+    mapped_file.cpp \
+    directory_crawler.cpp \
+    directory_watcher.cpp \
+    indexing_pipeline.cpp \
+    text_detector.cpp \
+    match_locator.cpp \
+    query_cache.cpp \
+    case_folding.cpp \
+    regex_parser.cpp \
+    regex_query.cpp \
+    regex_matcher.cpp \
+    aho_corasick.cpp \
+    fuzzy_matcher.cpp
 
 HEADERS += \
         mainwindow.h \
-    scantools.h
+    scantools.h \
+    trigram_index.h \
+    file_table.h \
+    trigram_extractor.h \
+    substring_matcher.h \
+    mapped_file.h \
+    directory_crawler.h \
+    directory_watcher.h \
+    indexing_pipeline.h \
+    text_detector.h \
+    match_locator.h \
+    query_cache.h \
+    case_folding.h \
+    regex_parser.h \
+    regex_query.h \
+    regex_matcher.h \
+    aho_corasick.h \
+    fuzzy_matcher.h \
+    trigrams.hpp \
+    utf8.hpp \
+    fast_hash.hpp \
+    bounded_queue.hpp \
+    cancellation.hpp \
+    shared_array.hpp
 
 FORMS += \
         mainwindow.ui
@@ -0,0 +1,120 @@
+#include "substring_matcher.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SUBSTRING_MATCHER_X86
+#include <immintrin.h>
+#endif
+
+const std::size_t LONG_PATTERN = 32;
+
+static std::int64_t find_scalar(char const *data, std::size_t len, char const *pattern, std::size_t m, std::size_t from) {
+    if (m > len) return -1;
+    char const *end = data + len - m + 1;
+    for (char const *p = data + from; p < end; p++) {
+        p = static_cast<char const *>(std::memchr(p, pattern[0], end - p));
+        if (p == nullptr) return -1;
+        if (std::memcmp(p + 1, pattern + 1, m - 1) == 0) return p - data;
+    }
+    return -1;
+}
+
+#ifdef SUBSTRING_MATCHER_X86
+__attribute__((target("sse2")))
+static std::int64_t find_sse2(char const *data, std::size_t len, char const *pattern, std::size_t m) {
+    const __m128i first = _mm_set1_epi8(pattern[0]);
+    const __m128i last = _mm_set1_epi8(pattern[m - 1]);
+    std::size_t i = 0;
+    for (; i + m + 15 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i + m - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        for (; mask != 0; mask &= mask - 1) {
+            std::size_t k = i + __builtin_ctz(mask);
+            if (std::memcmp(data + k + 1, pattern + 1, m - 2) == 0) return k;
+        }
+    }
+    return find_scalar(data, len, pattern, m, i);
+}
+
+__attribute__((target("avx2")))
+static std::int64_t find_avx2(char const *data, std::size_t len, char const *pattern, std::size_t m) {
+    const __m256i first = _mm256_set1_epi8(pattern[0]);
+    const __m256i last = _mm256_set1_epi8(pattern[m - 1]);
+    std::size_t i = 0;
+    for (; i + m + 31 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + i + m - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        for (; mask != 0; mask &= mask - 1) {
+            std::size_t k = i + __builtin_ctz(mask);
+            if (std::memcmp(data + k + 1, pattern + 1, m - 2) == 0) return k;
+        }
+    }
+    return find_scalar(data, len, pattern, m, i);
+}
+#endif
+
+typedef std::int64_t (*find_kernel)(char const *, std::size_t, char const *, std::size_t);
+
+static std::int64_t find_plain(char const *data, std::size_t len, char const *pattern, std::size_t m) {
+    return find_scalar(data, len, pattern, m, 0);
+}
+
+static find_kernel select_kernel(char const **name) {
+#ifdef SUBSTRING_MATCHER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return find_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        *name = "sse2";
+        return find_sse2;
+    }
+#endif
+    *name = "scalar";
+    return find_plain;
+}
+
+static char const *kernel = nullptr;
+static const find_kernel find_best = select_kernel(&kernel);
+
+char const *substring_matcher::kernel_name() {
+    return kernel;
+}
+
+substring_matcher::substring_matcher(const std::string &pattern) : pattern(pattern) {
+    std::size_t m = pattern.size();
+    use_horspool = m >= LONG_PATTERN;
+    for (std::size_t c = 0; c < 256; c++) {
+        shift[c] = m;
+    }
+    for (std::size_t i = 0; i + 1 < m; i++) {
+        shift[static_cast<std::uint8_t>(pattern[i])] = m - 1 - i;
+    }
+}
+
+std::int64_t substring_matcher::find_horspool(char const *data, std::size_t len) const {
+    std::size_t m = pattern.size();
+    char const *p = pattern.data();
+    for (std::size_t i = 0; i + m <= len;) {
+        char c = data[i + m - 1];
+        if (c == p[m - 1] && data[i] == p[0] && std::memcmp(data + i + 1, p + 1, m - 2) == 0) return i;
+        i += shift[static_cast<std::uint8_t>(c)];
+    }
+    return -1;
+}
+
+std::int64_t substring_matcher::find(char const *data, std::size_t len) const {
+    std::size_t m = pattern.size();
+    if (m == 0) return 0;
+    if (m > len) return -1;
+    if (m == 1) {
+        char const *p = static_cast<char const *>(std::memchr(data, pattern[0], len));
+        return (p == nullptr) ? -1 : p - data;
+    }
+    if (use_horspool) return find_horspool(data, len);
+    return find_best(data, len, pattern.data(), m);
+}
@@ -0,0 +1,33 @@
+#ifndef SUBSTRING_MATCHER_H
+#define SUBSTRING_MATCHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Pattern compiled once per query and shared by all verifying threads.
+ * Short patterns are searched with a first-and-last byte SIMD filter,
+ * long ones with Boyer-Moore-Horspool.
+ */
+class substring_matcher {
+    std::string pattern;
+    std::size_t shift[256];
+    bool use_horspool;
+
+    std::int64_t find_horspool(char const *data, std::size_t len) const;
+
+public:
+    explicit substring_matcher(const std::string &pattern);
+
+    const std::string &text() const { return pattern; }
+    std::size_t length() const { return pattern.size(); }
+
+    /* position of the first occurrence in data or -1 */
+    std::int64_t find(char const *data, std::size_t len) const;
+
+    /* name of the filter chosen for this cpu: "avx2", "sse2" or "scalar" */
+    static char const *kernel_name();
+};
+
+#endif // SUBSTRING_MATCHER_H
@@ -0,0 +1,147 @@
+#include "text_detector.h"
+#include "utf8_validator.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEXT_DETECTOR_X86
+#include <immintrin.h>
+#endif
+
+static char const *const BINARY_EXTENSIONS[] = {
+    "png", "jpg", "jpeg", "gif", "bmp", "ico", "webp", "tif", "tiff", "psd",
+    "mp3", "mp4", "m4a", "avi", "mkv", "mov", "wav", "flac", "ogg", "webm",
+    "zip", "gz", "tgz", "bz2", "xz", "7z", "rar", "jar", "war", "whl",
+    "o", "a", "so", "dylib", "dll", "exe", "obj", "lib", "class", "pyc",
+    "pdf", "iso", "img", "dmg", "woff", "woff2", "ttf", "otf", "eot", "sqlite",
+};
+
+struct magic_number {
+    char const *bytes;
+    std::size_t length;
+};
+
+static const magic_number MAGIC_NUMBERS[] = {
+    {"\x7f" "ELF", 4},
+    {"\x89" "PNG", 4},
+    {"GIF87a", 6},
+    {"GIF89a", 6},
+    {"\xff\xd8\xff", 3},
+    {"PK\x03\x04", 4},
+    {"\x1f\x8b", 2},
+    {"BZh", 3},
+    {"\xfd" "7zXZ", 5},
+    {"7z\xbc\xaf", 4},
+    {"Rar!", 4},
+    {"%PDF-", 5},
+    {"\xca\xfe\xba\xbe", 4},
+    {"SQLite format 3", 15},
+};
+
+const std::size_t text_detector::SNIFF_SIZE;
+
+bool text_detector::binary_extension(const std::string &path) {
+    std::size_t dot = path.rfind('.');
+    std::size_t slash = path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return false;
+    std::string extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    for (char const *binary : BINARY_EXTENSIONS) {
+        if (extension == binary) return true;
+    }
+    return false;
+}
+
+bool text_detector::binary_header(char const *data, std::size_t len) {
+    len = std::min(len, SNIFF_SIZE);
+    for (const magic_number &magic : MAGIC_NUMBERS) {
+        if (len >= magic.length && std::memcmp(data, magic.bytes, magic.length) == 0) return true;
+    }
+    return len > 0 && std::memchr(data, 0, len) != nullptr;
+}
+
+/* kernels return the length of the ASCII prefix of data */
+
+static std::size_t ascii_scalar(char const *data, std::size_t len, std::size_t from) {
+    std::size_t i = from;
+    for (; i + 8 <= len; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        if (word & 0x8080808080808080ull) break;
+    }
+    while (i < len && !(data[i] & 0x80)) i++;
+    return i;
+}
+
+#ifdef TEXT_DETECTOR_X86
+__attribute__((target("sse2")))
+static std::size_t ascii_sse2(char const *data, std::size_t len) {
+    std::size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i + 16));
+        if (_mm_movemask_epi8(_mm_or_si128(a, b)) != 0) break;
+    }
+    return ascii_scalar(data, len, i);
+}
+
+__attribute__((target("avx2")))
+static std::size_t ascii_avx2(char const *data, std::size_t len) {
+    std::size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + i + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(a, b)) != 0) break;
+    }
+    return ascii_scalar(data, len, i);
+}
+#endif
+
+typedef std::size_t (*ascii_kernel)(char const *, std::size_t);
+
+static std::size_t ascii_plain(char const *data, std::size_t len) {
+    return ascii_scalar(data, len, 0);
+}
+
+static ascii_kernel select_kernel(char const **name) {
+#ifdef TEXT_DETECTOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return ascii_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        *name = "sse2";
+        return ascii_sse2;
+    }
+#endif
+    *name = "scalar";
+    return ascii_plain;
+}
+
+static char const *kernel = nullptr;
+static const ascii_kernel ascii_prefix = select_kernel(&kernel);
+
+char const *text_detector::kernel_name() {
+    return kernel;
+}
+
+/* the automaton only runs over multibyte sequences, between them ASCII is skipped by the kernel */
+std::uint32_t text_detector::validate(std::uint32_t *state, char const *data, std::size_t len) {
+    std::uint32_t current = *state;
+    for (std::size_t i = 0; i < len; i++) {
+        std::uint8_t byte = static_cast<std::uint8_t>(data[i]);
+        if (current == UTF8_ACCEPT && byte < 0x80) {
+            i += ascii_prefix(data + i, len - i);
+            if (i == len) break;
+            byte = static_cast<std::uint8_t>(data[i]);
+        }
+        current = utf8d[256 + current + utf8d[byte]];
+        if (current == UTF8_REJECT) break;
+    }
+    *state = current;
+    return current;
+}
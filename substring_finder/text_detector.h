@@ -0,0 +1,32 @@
+#ifndef TEXT_DETECTOR_H
+#define TEXT_DETECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Decides whether a file is text worth indexing. Binary files are recognized
+ * cheaply by their extension or by the first SNIFF_SIZE bytes, everything
+ * else has to be valid UTF-8.
+ */
+class text_detector {
+public:
+    static const std::size_t SNIFF_SIZE = 4096;
+
+    /* extensions of formats which are never text: images, archives, objects.. */
+    static bool binary_extension(const std::string &path);
+    /* NUL bytes or a known magic number among the first SNIFF_SIZE bytes */
+    static bool binary_header(char const *data, std::size_t len);
+
+    /*
+     * Same contract as validate_utf8: continues from *state, returns the new
+     * state, which is UTF8_REJECT as soon as an invalid sequence is found.
+     * Runs of ASCII are skipped 64 (avx2) or 32 (sse2) bytes at a time.
+     */
+    static std::uint32_t validate(std::uint32_t *state, char const *data, std::size_t len);
+    /* name of the kernel chosen for this cpu: "avx2", "sse2" or "scalar" */
+    static char const *kernel_name();
+};
+
+#endif // TEXT_DETECTOR_H
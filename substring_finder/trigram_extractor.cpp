@@ -0,0 +1,106 @@
+#include "trigram_extractor.h"
+
+#include <algorithm>
+
+/* the vector kernels pack three bytes, other gram sizes use the scalar one */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && INDEX_GRAM_SIZE == 3
+#define TRIGRAM_EXTRACTOR_X86
+#include <immintrin.h>
+#endif
+
+const std::size_t CHUNK_SIZE = 4096;
+
+static std::size_t extract_scalar(char const *data, std::size_t len, trigram *out, std::size_t from) {
+    for (std::size_t i = from; i + GRAM_SIZE <= len; i++) {
+        out[i] = pack_trigram(data + i);
+    }
+    return (len < GRAM_SIZE) ? 0 : len - GRAM_SIZE + 1;
+}
+
+#ifdef TRIGRAM_EXTRACTOR_X86
+__attribute__((target("sse2")))
+static std::size_t extract_sse2(char const *data, std::size_t len, trigram *out) {
+    const __m128i zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 18 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i + 1));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i + 2));
+        /* a << 8 | b in 16-bit lanes, then widen and or with c */
+        __m128i ab_lo = _mm_or_si128(_mm_slli_epi16(_mm_unpacklo_epi8(a, zero), 8), _mm_unpacklo_epi8(b, zero));
+        __m128i ab_hi = _mm_or_si128(_mm_slli_epi16(_mm_unpackhi_epi8(a, zero), 8), _mm_unpackhi_epi8(b, zero));
+        __m128i c_lo = _mm_unpacklo_epi8(c, zero);
+        __m128i c_hi = _mm_unpackhi_epi8(c, zero);
+        __m128i *dst = reinterpret_cast<__m128i *>(out + i);
+        _mm_storeu_si128(dst + 0, _mm_or_si128(_mm_slli_epi32(_mm_unpacklo_epi16(ab_lo, zero), 8), _mm_unpacklo_epi16(c_lo, zero)));
+        _mm_storeu_si128(dst + 1, _mm_or_si128(_mm_slli_epi32(_mm_unpackhi_epi16(ab_lo, zero), 8), _mm_unpackhi_epi16(c_lo, zero)));
+        _mm_storeu_si128(dst + 2, _mm_or_si128(_mm_slli_epi32(_mm_unpacklo_epi16(ab_hi, zero), 8), _mm_unpacklo_epi16(c_hi, zero)));
+        _mm_storeu_si128(dst + 3, _mm_or_si128(_mm_slli_epi32(_mm_unpackhi_epi16(ab_hi, zero), 8), _mm_unpackhi_epi16(c_hi, zero)));
+    }
+    return extract_scalar(data, len, out, i);
+}
+
+__attribute__((target("avx2")))
+static std::size_t extract_avx2(char const *data, std::size_t len, trigram *out) {
+    std::size_t i = 0;
+    for (; i + 10 <= len; i += 8) {
+        __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(data + i)));
+        __m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(data + i + 1)));
+        __m256i c = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(data + i + 2)));
+        __m256i code = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(a, 16), _mm256_slli_epi32(b, 8)), c);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), code);
+    }
+    return extract_scalar(data, len, out, i);
+}
+#endif
+
+typedef std::size_t (*extract_kernel)(char const *, std::size_t, trigram *);
+
+static std::size_t extract_plain(char const *data, std::size_t len, trigram *out) {
+    return extract_scalar(data, len, out, 0);
+}
+
+static extract_kernel select_kernel(char const **name) {
+#ifdef TRIGRAM_EXTRACTOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return extract_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        *name = "sse2";
+        return extract_sse2;
+    }
+#endif
+    *name = "scalar";
+    return extract_plain;
+}
+
+static char const *kernel = nullptr;
+static const extract_kernel extract_best = select_kernel(&kernel);
+
+std::size_t trigram_extractor::extract(char const *data, std::size_t len, trigram *out) {
+    return extract_best(data, len, out);
+}
+
+char const *trigram_extractor::kernel_name() {
+    return kernel;
+}
+
+void trigram_extractor::feed(char const *data, std::size_t len, trigram_set &trigrams) {
+    /* windows which start in the previous block */
+    std::size_t head = 0;
+    for (; head < len && head < GRAM_SIZE - 1; head++) {
+        code = ((code << 8) | static_cast<std::uint8_t>(data[head])) & TRIGRAM_MASK;
+        if (++number_of_bytes >= GRAM_SIZE) trigrams.insert(code);
+    }
+    if (head < GRAM_SIZE - 1) return;
+
+    trigram codes[CHUNK_SIZE];
+    for (std::size_t i = 0; i + GRAM_SIZE - 1 < len; i += CHUNK_SIZE) {
+        std::size_t part = std::min(CHUNK_SIZE + GRAM_SIZE - 1, len - i);
+        trigrams.insert(codes, extract_best(data + i, part, codes));
+    }
+    code = pack_bytes(data + len - (GRAM_SIZE - 1), GRAM_SIZE - 1);
+    number_of_bytes += len - head;
+}
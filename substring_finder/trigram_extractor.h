@@ -0,0 +1,27 @@
+#ifndef TRIGRAM_EXTRACTOR_H
+#define TRIGRAM_EXTRACTOR_H
+
+#include <cstddef>
+
+#include "trigrams.hpp"
+
+/*
+ * Streams bytes of one file into a trigram_set. Blocks may be fed in pieces of
+ * any size, the last GRAM_SIZE - 1 bytes are carried over so grams crossing a
+ * block boundary are emitted as well.
+ */
+class trigram_extractor {
+    trigram code = 0;
+    std::size_t number_of_bytes = 0;
+
+public:
+    void feed(char const *data, std::size_t len, trigram_set &trigrams);
+    void reset() { code = 0; number_of_bytes = 0; }
+
+    /* writes len - GRAM_SIZE + 1 codes, one for every full window of data, returns their number */
+    static std::size_t extract(char const *data, std::size_t len, trigram *out);
+    /* name of the kernel chosen for this cpu: "avx2", "sse2" or "scalar" */
+    static char const *kernel_name();
+};
+
+#endif // TRIGRAM_EXTRACTOR_H
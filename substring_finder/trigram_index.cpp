@@ -0,0 +1,983 @@
+#include "trigram_index.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include "fast_hash.hpp"
+
+const std::uint64_t file_chunk::TO_END_OF_FILE;
+
+namespace {
+    /* heap bytes of a list in memory with its node in the map */
+    std::size_t memory_of(const posting_list &list) {
+        return list.data.capacity() + list.skips.capacity() * sizeof(posting_skip) +
+               sizeof(std::pair<const trigram, posting_list>) + 2 * sizeof(void *);
+    }
+}
+
+void posting_list::push_back(file_id id) {
+    std::uint32_t delta = (count == 0) ? id : id - last;
+    while (delta >= 0x80) {
+        data.push_back(static_cast<std::uint8_t>(delta | 0x80));
+        delta >>= 7;
+    }
+    data.push_back(static_cast<std::uint8_t>(delta));
+    if (count % SKIP_INTERVAL == 0) {
+        skips.push_back({id, static_cast<std::uint32_t>(data.size())});
+    }
+    last = id;
+    count++;
+}
+
+posting_view posting_list::view() const {
+    return {data.data(), skips.data(), static_cast<std::uint32_t>(skips.size()), count, last};
+}
+
+posting_cursor::posting_cursor(std::vector<posting_view> parts) : parts(std::move(parts)), total(0) {
+    for (const posting_view &p : this->parts) total += p.count;
+    enter(0);
+}
+
+void posting_cursor::enter(std::size_t next_part) {
+    part = next_part;
+    while (valid() && parts[part].count == 0) part++;
+    index = 0;
+    offset = 0;
+    current = 0;
+    if (valid()) read();
+}
+
+void posting_cursor::read() {
+    const std::uint8_t *data = parts[part].data;
+    std::uint32_t delta = 0;
+    for (std::uint32_t shift = 0;; shift += 7) {
+        std::uint8_t byte = data[offset++];
+        delta |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    current += delta;
+}
+
+void posting_cursor::next() {
+    if (++index < parts[part].count) {
+        read();
+    } else {
+        enter(part + 1);
+    }
+}
+
+bool posting_cursor::advance_to(file_id target) {
+    if (!valid()) return false;
+    if (current >= target) return true;
+    while (valid() && parts[part].last < target) enter(part + 1);
+    if (!valid()) return false;
+    if (current >= target) return true;
+    const posting_view &view = parts[part];
+    const posting_skip *it = std::upper_bound(view.skips, view.skips + view.number_of_skips, target,
+                                              [](file_id t, const posting_skip &skip) { return t < skip.id; });
+    if (it != view.skips) {
+        --it;
+        std::uint32_t k = static_cast<std::uint32_t>(it - view.skips) * posting_list::SKIP_INTERVAL;
+        if (k > index) {
+            index = k;
+            current = it->id;
+            offset = it->offset;
+        }
+    }
+    while (current < target) next();
+    return true;
+}
+
+const std::uint8_t trigram_index::INDEXED;
+const std::uint8_t trigram_index::SKIPPED;
+const std::uint8_t trigram_index::COPY;
+const unsigned trigram_index::BASE;
+const std::size_t trigram_index::MERGE_WIDTH;
+const file_id trigram_index::NONE;
+
+file_entry trigram_index::add_entry(const std::string &path, file_fingerprint fingerprint, std::uint8_t flags) {
+    remove_file(path);
+    file_entry entry = table.add(path);
+    table.set_metadata(entry, fingerprint.size, fingerprint.modified);
+    table.set_flags(entry, flags);
+    if (first_chunks.size() < table.end()) {
+        first_chunks.resize(table.end(), NONE);
+        contents.resize(table.end(), 0);
+        next_copies.resize(table.end(), file_table::NONE);
+    }
+    first_chunks.set(entry, (flags & INDEXED) ? static_cast<file_id>(owners.size()) : NONE);
+    contents.set(entry, 0);
+    next_copies.set(entry, file_table::NONE);
+    if (flags & INDEXED) {
+        number_of_files++;
+    }
+    return entry;
+}
+
+file_id trigram_index::add_file(const std::string &path, const std::vector<trigram> &trigrams, file_fingerprint fingerprint) {
+    file_entry entry = add_entry(path, fingerprint, INDEXED);
+    file_id id = static_cast<file_id>(owners.size());
+    owners.push_back(entry);
+    chunks.push_back({0, file_chunk::TO_END_OF_FILE, 0, 0});
+    alive.push_back(true);
+    for (trigram t : trigrams) {
+        add_postings(t, id);
+    }
+    spill_if_needed();
+    return id;
+}
+
+std::unordered_map<content_key, file_entry, content_key_hash> &trigram_index::content_map() {
+    if (!by_content.complete) {
+        for (file_entry entry = 0; entry < table.end(); entry++) {
+            if (contains(entry) && !(table.flags(entry) & COPY) && contents[entry] != 0) {
+                by_content.owners[content(entry)] = entry;
+            }
+        }
+        by_content.complete = true;
+    }
+    return by_content.owners;
+}
+
+/* a new copy is found through old ids, so cached searches cannot tell it changed */
+void trigram_index::add_copy(file_entry entry, file_entry original) {
+    table.set_flags(entry, INDEXED | COPY);
+    first_chunks.set(entry, first_chunks[original]);
+    next_copies.set(entry, next_copies[original]);
+    next_copies.set(original, entry);
+    number_of_copies++;
+    layout++;
+}
+
+file_id trigram_index::add_chunks(const std::string &path, const std::vector<chunk_trigrams> &file_chunks,
+                                  file_fingerprint fingerprint, std::uint64_t content) {
+    if (content == 0 && file_chunks.empty()) return add_file(path, {}, fingerprint);
+    file_entry entry = add_entry(path, fingerprint, INDEXED);
+    if (content != 0) {
+        contents.set(entry, content);
+        content_map()[this->content(entry)] = entry;
+    }
+    file_id first = static_cast<file_id>(owners.size());
+    if (file_chunks.empty()) {
+        owners.push_back(entry);
+        chunks.push_back({0, file_chunk::TO_END_OF_FILE, 0, 0});
+        alive.push_back(true);
+    }
+    for (const chunk_trigrams &c : file_chunks) {
+        file_id id = static_cast<file_id>(owners.size());
+        owners.push_back(entry);
+        chunks.push_back(c.chunk);
+        alive.push_back(true);
+        for (trigram t : c.trigrams) {
+            add_postings(t, id);
+        }
+    }
+    spill_if_needed();
+    return first;
+}
+
+bool trigram_index::add_duplicate(const std::string &path, file_fingerprint fingerprint, std::uint64_t content) {
+    auto it = content_map().find({fingerprint.size, content});
+    if (content == 0 || it == content_map().end() || table.path(it->second) == path) return false;
+    file_entry original = it->second;
+    file_entry entry = add_entry(path, fingerprint, INDEXED);
+    contents.set(entry, content);
+    add_copy(entry, original);
+    return true;
+}
+
+void trigram_index::add_postings(trigram t, file_id id) {
+    posting_list &list = postings[t];
+    std::size_t before = list.count == 0 ? 0 : memory_of(list);
+    list.push_back(id);
+    memory += memory_of(list) - before;
+}
+
+void trigram_index::skip_file(const std::string &path, file_fingerprint fingerprint) {
+    add_entry(path, fingerprint, SKIPPED);
+}
+
+bool trigram_index::is_unchanged(const std::string &path, file_fingerprint fingerprint) const {
+    file_entry entry = table.find(path);
+    return entry != file_table::NONE && this->fingerprint(entry) == fingerprint;
+}
+
+bool trigram_index::remove_file(const std::string &path) {
+    return remove_file(table.find(path));
+}
+
+/* the chunks of a file which has copies are handed over to the next copy */
+bool trigram_index::remove_file(file_entry entry) {
+    if (!table.used(entry)) return false;
+    if (table.flags(entry) & COPY) {
+        file_entry previous = owners[first_chunks[entry]];
+        while (next_copies[previous] != entry) previous = next_copies[previous];
+        next_copies.set(previous, next_copies[entry]);
+        number_of_copies--;
+        number_of_files--;
+    } else if (table.flags(entry) & INDEXED) {
+        file_entry heir = next_copies[entry];
+        for (file_id id = first_chunks[entry]; id < owners.size() && alive[id] && owners[id] == entry; id++) {
+            if (heir != file_table::NONE) {
+                owners.set(id, heir);
+            } else {
+                alive.set(id, false);
+                number_of_dead++;
+            }
+        }
+        if (heir != file_table::NONE) {
+            table.set_flags(heir, INDEXED);
+            number_of_copies--;
+            layout++;
+        }
+        auto it = content_map().find(content(entry));
+        if (it != content_map().end() && it->second == entry) {
+            if (heir != file_table::NONE) {
+                it->second = heir;
+            } else {
+                content_map().erase(it);
+            }
+        }
+        number_of_files--;
+    }
+    first_chunks.set(entry, NONE);
+    contents.set(entry, 0);
+    next_copies.set(entry, file_table::NONE);
+    table.remove(entry);
+    size_t number_of_alive = owners.size() - number_of_dead;
+    if (number_of_dead > number_of_alive && number_of_dead > posting_list::SKIP_INTERVAL) compact();
+    return true;
+}
+
+void trigram_index::clear() {
+    table.clear();
+    first_chunks.clear();
+    contents.clear();
+    next_copies.clear();
+    by_content.owners.clear();
+    by_content.complete = true;
+    owners.clear();
+    chunks.clear();
+    alive.clear();
+    postings.clear();
+    memory = 0;
+    number_of_files = 0;
+    number_of_copies = 0;
+    number_of_dead = 0;
+    layout++;
+    drop_segments();
+}
+
+std::vector<std::string> trigram_index::files() const {
+    std::vector<std::string> result;
+    result.reserve(number_of_files);
+    for (file_entry entry = 0; entry < table.end(); entry++) {
+        if (contains(entry)) result.push_back(table.path(entry));
+    }
+    return result;
+}
+
+std::vector<file_entry> trigram_index::copies(file_entry owner) const {
+    std::vector<file_entry> result;
+    for (file_entry entry = next_copies[owner]; entry != file_table::NONE; entry = next_copies[entry]) {
+        result.push_back(entry);
+    }
+    return result;
+}
+
+std::vector<file_id> trigram_index::all_files() const {
+    std::vector<file_id> result;
+    result.reserve(number_of_files);
+    for (file_id id = 0; id < owners.size(); id++) {
+        if (alive[id] && chunks[id].offset == 0) result.push_back(id);
+    }
+    return result;
+}
+
+std::vector<file_id> trigram_index::files_with(trigram t) const {
+    std::vector<file_id> result;
+    for (posting_cursor cursor(lookup(t, true)); cursor.valid(); cursor.next()) {
+        file_id id = cursor.value();
+        if (!alive[id]) continue;
+        id = first_chunks[owners[id]];
+        if (result.empty() || result.back() != id) result.push_back(id);
+    }
+    return result;
+}
+
+std::vector<std::string> trigram_index::known_files() const {
+    std::vector<std::string> result;
+    result.reserve(table.size());
+    for (file_entry entry = 0; entry < table.end(); entry++) {
+        if (table.used(entry)) result.push_back(table.path(entry));
+    }
+    return result;
+}
+
+std::unordered_map<std::string, file_fingerprint> trigram_index::known_fingerprints() const {
+    std::unordered_map<std::string, file_fingerprint> result;
+    result.reserve(table.size());
+    for (file_entry entry = 0; entry < table.end(); entry++) {
+        if (table.used(entry)) result.emplace(table.path(entry), fingerprint(entry));
+    }
+    return result;
+}
+
+bool trigram_index::segment::find(trigram t, posting_view &view) const {
+    const disk_entry *entry = std::lower_bound(dictionary, dictionary + dictionary_size, t,
+                                               [](const disk_entry &e, trigram code) { return e.code < code; });
+    if (entry == dictionary + dictionary_size || entry->code != t) return false;
+    view = {postings + entry->data_offset, skips + entry->skip_offset, entry->number_of_skips, entry->count, entry->last};
+    return true;
+}
+
+std::vector<posting_view> trigram_index::lookup(trigram t, bool counted) const {
+    std::vector<posting_view> parts;
+    posting_view view;
+    bool in_base = false;
+    bool in_spilled = false;
+    for (const segment &s : segments) {
+        if (!s.find(t, view)) continue;
+        parts.push_back(view);
+        (s.level == BASE ? in_base : in_spilled) = true;
+    }
+    auto it = postings.find(t);
+    bool in_memory = it != postings.end() && it->second.count > 0;
+    if (in_memory) parts.push_back(it->second.view());
+    if (counted && !parts.empty()) {
+        counters->lookups++;
+        if (in_memory) counters->memory_hits++;
+        if (in_spilled) counters->spilled_hits++;
+        if (in_base) counters->base_hits++;
+    }
+    return parts;
+}
+
+std::vector<trigram> trigram_index::all_trigrams() const {
+    std::vector<trigram> result;
+    result.reserve(postings.size());
+    for (const segment &s : segments) {
+        for (std::size_t i = 0; i < s.dictionary_size; i++) result.push_back(s.dictionary[i].code);
+    }
+    for (auto it = postings.begin(); it != postings.end(); ++it) result.push_back(it->first);
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+std::vector<file_id> trigram_index::candidates(const std::vector<trigram> &trigrams, query_plan *plan) const {
+    std::vector<file_id> result;
+    std::vector<trigram> distinct(trigrams);
+    std::sort(distinct.begin(), distinct.end());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+
+    std::vector<std::pair<trigram, posting_cursor>> cursors;
+    for (trigram t : distinct) {
+        cursors.emplace_back(t, posting_cursor(lookup(t, true)));
+    }
+    std::sort(cursors.begin(), cursors.end(), [](const std::pair<trigram, posting_cursor> &a,
+                                                 const std::pair<trigram, posting_cursor> &b) {
+        return a.second.size() < b.second.size();
+    });
+
+    double number_of_alive = static_cast<double>(owners.size() - number_of_dead);
+    size_t used = 0;
+    if (cursors.empty()) {
+        for (file_id id = 0; id < owners.size(); id++) {
+            if (alive[id]) result.push_back(id);
+        }
+    } else {
+        for (posting_cursor &cursor = cursors[0].second; cursor.valid(); cursor.next()) {
+            if (alive[cursor.value()]) result.push_back(cursor.value());
+        }
+        /*
+         * a list is worth walking while it is expected to drop at least one
+         * candidate, otherwise verifying them directly is cheaper
+         */
+        for (used = 1; used < cursors.size(); used++) {
+            posting_cursor &cursor = cursors[used].second;
+            if (result.size() * (1 - cursor.size() / number_of_alive) < 1) break;
+            size_t k = 0;
+            for (file_id id : result) {
+                if (cursor.advance_to(id) && cursor.value() == id) result[k++] = id;
+            }
+            result.resize(k);
+        }
+    }
+
+    if (plan != nullptr) {
+        plan->trigrams.clear();
+        plan->frequencies.clear();
+        plan->estimated = number_of_alive;
+        for (size_t i = 0; i < cursors.size(); i++) {
+            plan->trigrams.push_back(cursors[i].first);
+            plan->frequencies.push_back(cursors[i].second.size());
+            if (i < used && number_of_alive > 0) {
+                plan->estimated *= std::min(1.0, cursors[i].second.size() / number_of_alive);
+            }
+        }
+        plan->used = used;
+        plan->candidates = result.size();
+    }
+    return result;
+}
+
+std::vector<file_id> trigram_index::candidates_sharing(const std::vector<trigram> &trigrams,
+                                                       std::size_t threshold) const {
+    if (threshold == 0) return candidates({});
+    std::vector<trigram> sorted(trigrams);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<std::uint32_t> counts(owners.size(), 0);
+    for (size_t i = 0, j; i < sorted.size(); i = j) {
+        for (j = i; j < sorted.size() && sorted[j] == sorted[i]; j++) {}
+        for (posting_cursor cursor(lookup(sorted[i], true)); cursor.valid(); cursor.next()) {
+            counts[cursor.value()] += static_cast<std::uint32_t>(j - i);
+        }
+    }
+    std::vector<file_id> result;
+    for (file_id id = 0; id < owners.size(); id++) {
+        if (alive[id] && counts[id] >= threshold) result.push_back(id);
+    }
+    return result;
+}
+
+/*
+ * Index file layout, every section starts at a multiple of 8:
+ *   index_header
+ *   uint64 path offsets [number_of_files + 1], path bytes
+ *   file_fingerprint [number_of_files]
+ *   file_chunk [number_of_files]
+ *   uint64 content hash [number_of_files]
+ *   uint64 path offsets [number_of_skipped + 1], path bytes of skipped files
+ *   file_fingerprint [number_of_skipped]
+ *   uint64 path offsets [number_of_copies + 1], path bytes of copies
+ *   file_fingerprint [number_of_copies]
+ *   file_id [number_of_copies], the first chunk of the file they are copies of
+ *   posting bytes
+ *   posting_skip [number_of_skips]
+ *   disk_entry [number_of_trigrams], sorted by code
+ * The checksum covers everything after the header.
+ */
+namespace {
+    const char INDEX_MAGIC[8] = {'S', 'S', 'F', 'I', 'N', 'D', 'E', 'X'};
+    const std::uint32_t INDEX_BYTE_ORDER = 0x01020304;
+
+    struct index_header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        /* GRAM_SIZE of the build which wrote it, keys of other sizes mean nothing */
+        std::uint32_t gram_size;
+        std::uint32_t reserved;
+        std::uint64_t checksum;
+        std::uint64_t number_of_files;
+        std::uint64_t paths_size;
+        std::uint64_t number_of_skipped;
+        std::uint64_t skipped_paths_size;
+        std::uint64_t number_of_copies;
+        std::uint64_t copies_paths_size;
+        std::uint64_t postings_size;
+        std::uint64_t number_of_skips;
+        std::uint64_t number_of_trigrams;
+    };
+
+    std::uint64_t align8(std::uint64_t size) {
+        return (size + 7) & ~std::uint64_t(7);
+    }
+
+    struct index_writer {
+        std::ofstream out;
+        fast_hash hash;
+        std::uint64_t written = 0;
+
+        explicit index_writer(const std::string &file_name) : out(file_name, std::ios::binary | std::ios::trunc) {}
+
+        void write(const void *data, std::size_t len) {
+            out.write(static_cast<char const *>(data), len);
+            hash.update(static_cast<char const *>(data), len);
+            written += len;
+        }
+
+        void pad() {
+            static const char zeros[8] = {};
+            write(zeros, align8(written) - written);
+        }
+    };
+
+    /* a spilled segment has the posting sections of an index file and nothing else */
+    const char SPILL_MAGIC[8] = {'S', 'S', 'F', 'S', 'P', 'I', 'L', 'L'};
+
+    struct spill_header {
+        char magic[8];
+        std::uint64_t postings_size;
+        std::uint64_t number_of_skips;
+        std::uint64_t number_of_trigrams;
+    };
+
+    std::atomic<std::uint32_t> number_of_spills(0);
+}
+
+/* writes posting lists in the order of their keys, then their skips and the dictionary */
+struct trigram_index::postings_writer {
+    index_writer &writer;
+    std::uint64_t start;
+    std::vector<posting_skip> skips;
+    std::vector<disk_entry> entries;
+
+    explicit postings_writer(index_writer &writer) : writer(writer), start(writer.written) {}
+
+    void add(trigram t, const posting_list &list) {
+        entries.push_back({t, list.count, writer.written - start, skips.size(),
+                           static_cast<std::uint32_t>(list.skips.size()), list.last});
+        writer.write(list.data.data(), list.data.size());
+        skips.insert(skips.end(), list.skips.begin(), list.skips.end());
+    }
+
+    /* returns the size of the postings */
+    std::uint64_t finish() {
+        std::uint64_t size = writer.written - start;
+        writer.pad();
+        writer.write(skips.data(), skips.size() * sizeof(posting_skip));
+        writer.write(entries.data(), entries.size() * sizeof(disk_entry));
+        return size;
+    }
+};
+
+struct trigram_index::merge_task {
+    std::vector<segment> inputs;
+    /* ids which were removed before the merge started are dropped */
+    shared_array<bool> alive;
+    segment output = {};
+    bool succeeded = false;
+    std::atomic<bool> finished{false};
+    std::thread thread;
+
+    void wait() {
+        if (thread.joinable()) thread.join();
+    }
+    ~merge_task() { wait(); }
+};
+
+/* merge_task is complete only here */
+trigram_index::running_merge::running_merge() {
+}
+
+trigram_index::running_merge::running_merge(const running_merge &) {
+}
+
+trigram_index::running_merge::running_merge(running_merge &&another) : task(std::move(another.task)) {
+}
+
+trigram_index::running_merge &trigram_index::running_merge::operator=(const running_merge &) {
+    return *this;
+}
+
+trigram_index::running_merge &trigram_index::running_merge::operator=(running_merge &&another) {
+    task = std::move(another.task);
+    return *this;
+}
+
+trigram_index::running_merge::~running_merge() {
+}
+
+/*
+ * Drops removed files from every posting list and renumbers the rest densely.
+ * All segments are replaced by one, or by lists in memory if there is no budget.
+ */
+void trigram_index::compact() {
+    std::vector<file_id> renumber(owners.size());
+    shared_array<file_entry> new_owners;
+    shared_array<file_chunk> new_chunks;
+    for (file_id id = 0; id < owners.size(); id++) {
+        if (!alive[id]) continue;
+        renumber[id] = static_cast<file_id>(new_owners.size());
+        if (chunks[id].offset == 0) {
+            for (file_entry entry = owners[id]; entry != file_table::NONE; entry = next_copies[entry]) {
+                first_chunks.set(entry, renumber[id]);
+            }
+        }
+        new_owners.push_back(owners[id]);
+        new_chunks.push_back(chunks[id]);
+    }
+    auto renumbered = [&] (trigram t) {
+        posting_list list;
+        for (posting_cursor cursor(lookup(t)); cursor.valid(); cursor.next()) {
+            if (alive[cursor.value()]) list.push_back(renumber[cursor.value()]);
+        }
+        return list;
+    };
+    std::vector<trigram> codes = all_trigrams();
+    std::string file_name = spill_file_name();
+    segment compacted_segment;
+    bool spilled = memory_budget > 0 && write_segment(file_name, [&] (postings_writer &writer) {
+        for (trigram t : codes) {
+            posting_list list = renumbered(t);
+            if (list.count > 0) writer.add(t, list);
+        }
+    }) && open_segment(file_name, BASE, compacted_segment);
+    std::unordered_map<trigram, posting_list> compacted;
+    for (std::size_t i = 0; !spilled && i < codes.size(); i++) {
+        posting_list list = renumbered(codes[i]);
+        if (list.count > 0) compacted.emplace(codes[i], std::move(list));
+    }
+    drop_segments();
+    if (spilled) segments.push_back(std::move(compacted_segment));
+    postings = std::move(compacted);
+    memory = 0;
+    for (auto it = postings.begin(); it != postings.end(); ++it) memory += memory_of(it->second);
+    owners = std::move(new_owners);
+    chunks = std::move(new_chunks);
+    alive.assign(owners.size(), true);
+    number_of_dead = 0;
+    layout++;
+}
+
+bool trigram_index::save(const std::string &file_name) const {
+    std::string temporary = file_name + ".tmp";
+    index_writer writer(temporary);
+    if (!writer.out) return false;
+
+    index_header header = {};
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = FORMAT_VERSION;
+    header.byte_order = INDEX_BYTE_ORDER;
+    header.gram_size = GRAM_SIZE;
+    writer.out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+
+    std::vector<file_id> renumber(owners.size());
+    std::vector<std::string> paths;
+    std::uint64_t path_offset = 0;
+    for (file_id id = 0; id < owners.size(); id++) {
+        if (!alive[id]) continue;
+        renumber[id] = static_cast<file_id>(header.number_of_files++);
+        if (chunks[id].offset == 0) paths.push_back(table.path(owners[id]));
+        writer.write(&path_offset, sizeof(path_offset));
+        path_offset += paths.back().size();
+    }
+    writer.write(&path_offset, sizeof(path_offset));
+    for (file_id id = 0, i = 0; id < owners.size(); id++) {
+        if (!alive[id]) continue;
+        if (chunks[id].offset == 0) i++;
+        writer.write(paths[i - 1].data(), paths[i - 1].size());
+    }
+    header.paths_size = path_offset;
+    writer.pad();
+    for (file_id id = 0; id < owners.size(); id++) {
+        if (!alive[id]) continue;
+        file_fingerprint stored = fingerprint(owners[id]);
+        writer.write(&stored, sizeof(file_fingerprint));
+    }
+    for (file_id id = 0; id < owners.size(); id++) {
+        if (alive[id]) writer.write(&chunks[id], sizeof(file_chunk));
+    }
+
+    for (file_id id = 0; id < owners.size(); id++) {
+        if (alive[id]) writer.write(&contents[owners[id]], sizeof(std::uint64_t));
+    }
+
+    /* files without chunks of their own, returns the size of their paths */
+    auto write_files = [&] (const std::vector<file_entry> &files) {
+        paths.clear();
+        std::uint64_t offset = 0;
+        for (file_entry entry : files) {
+            paths.push_back(table.path(entry));
+            writer.write(&offset, sizeof(offset));
+            offset += paths.back().size();
+        }
+        writer.write(&offset, sizeof(offset));
+        for (const std::string &path : paths) {
+            writer.write(path.data(), path.size());
+        }
+        writer.pad();
+        for (file_entry entry : files) {
+            file_fingerprint stored = fingerprint(entry);
+            writer.write(&stored, sizeof(file_fingerprint));
+        }
+        return offset;
+    };
+    std::vector<file_entry> skipped;
+    std::vector<file_entry> copied;
+    for (file_entry entry = 0; entry < table.end(); entry++) {
+        if (!table.used(entry)) continue;
+        if (table.flags(entry) & SKIPPED) {
+            skipped.push_back(entry);
+        } else if (table.flags(entry) & COPY) {
+            copied.push_back(entry);
+        }
+    }
+    header.number_of_skipped = skipped.size();
+    header.skipped_paths_size = write_files(skipped);
+    header.number_of_copies = copied.size();
+    header.copies_paths_size = write_files(copied);
+    for (file_entry entry : copied) {
+        file_id original = renumber[first_chunks[entry]];
+        writer.write(&original, sizeof(file_id));
+    }
+    writer.pad();
+
+    postings_writer lists(writer);
+    for (trigram t : all_trigrams()) {
+        posting_list list;
+        for (posting_cursor cursor(lookup(t)); cursor.valid(); cursor.next()) {
+            if (alive[cursor.value()]) list.push_back(renumber[cursor.value()]);
+        }
+        if (list.count > 0) lists.add(t, list);
+    }
+    header.number_of_skips = lists.skips.size();
+    header.number_of_trigrams = lists.entries.size();
+    header.postings_size = lists.finish();
+
+    header.checksum = writer.hash.digest();
+    writer.out.seekp(0);
+    writer.out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    writer.out.close();
+    if (!writer.out) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return std::rename(temporary.c_str(), file_name.c_str()) == 0;
+}
+
+bool trigram_index::load(const std::string &file_name) {
+    std::unique_ptr<mapped_file> file(new mapped_file(file_name));
+    if (!file->is_open() || file->size() < sizeof(index_header)) return false;
+    index_header header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != FORMAT_VERSION || header.byte_order != INDEX_BYTE_ORDER ||
+            header.gram_size != GRAM_SIZE) {
+        return false;
+    }
+
+    std::uint64_t offsets_start = sizeof(index_header);
+    std::uint64_t paths_start = offsets_start + (header.number_of_files + 1) * sizeof(std::uint64_t);
+    std::uint64_t fingerprints_start = align8(paths_start + header.paths_size);
+    std::uint64_t chunks_start = fingerprints_start + header.number_of_files * sizeof(file_fingerprint);
+    std::uint64_t contents_start = chunks_start + header.number_of_files * sizeof(file_chunk);
+    std::uint64_t skipped_offsets_start = contents_start + header.number_of_files * sizeof(std::uint64_t);
+    std::uint64_t skipped_paths_start = skipped_offsets_start + (header.number_of_skipped + 1) * sizeof(std::uint64_t);
+    std::uint64_t skipped_fingerprints_start = align8(skipped_paths_start + header.skipped_paths_size);
+    std::uint64_t copies_offsets_start = skipped_fingerprints_start + header.number_of_skipped * sizeof(file_fingerprint);
+    std::uint64_t copies_paths_start = copies_offsets_start + (header.number_of_copies + 1) * sizeof(std::uint64_t);
+    std::uint64_t copies_fingerprints_start = align8(copies_paths_start + header.copies_paths_size);
+    std::uint64_t originals_start = copies_fingerprints_start + header.number_of_copies * sizeof(file_fingerprint);
+    std::uint64_t postings_start = align8(originals_start + header.number_of_copies * sizeof(file_id));
+    std::uint64_t skips_start = align8(postings_start + header.postings_size);
+    std::uint64_t dictionary_start = skips_start + header.number_of_skips * sizeof(posting_skip);
+    std::uint64_t end = dictionary_start + header.number_of_trigrams * sizeof(disk_entry);
+    if (header.number_of_files >= UINT32_MAX || end != file->size()) return false;
+    if (hash64(file->data() + sizeof(index_header), file->size() - sizeof(index_header)) != header.checksum) {
+        return false;
+    }
+    /* the copies must point at first chunks; nothing is replaced before everything is checked */
+    const file_id *originals = reinterpret_cast<const file_id *>(file->data() + originals_start);
+    const file_chunk *stored_chunks = reinterpret_cast<const file_chunk *>(file->data() + chunks_start);
+    for (std::uint64_t i = 0; i < header.number_of_copies; i++) {
+        if (originals[i] >= header.number_of_files || stored_chunks[originals[i]].offset != 0) return false;
+    }
+
+    clear();
+    const std::uint64_t *path_offsets = reinterpret_cast<const std::uint64_t *>(file->data() + offsets_start);
+    char const *path_bytes = file->data() + paths_start;
+    const file_fingerprint *stored = reinterpret_cast<const file_fingerprint *>(file->data() + fingerprints_start);
+    const std::uint64_t *stored_contents = reinterpret_cast<const std::uint64_t *>(file->data() + contents_start);
+    /* the chunks of a file follow its first one, which carries the path for all of them */
+    file_entry entry = file_table::NONE;
+    for (file_id id = 0; id < header.number_of_files; id++) {
+        if (stored_chunks[id].offset == 0 || entry == file_table::NONE) {
+            std::string path(path_bytes + path_offsets[id], path_offsets[id + 1] - path_offsets[id]);
+            entry = add_entry(path, stored[id], INDEXED);
+            contents.set(entry, stored_contents[id]);
+            if (contents[entry] != 0) content_map().emplace(content(entry), entry);
+        }
+        owners.push_back(entry);
+        chunks.push_back(stored_chunks[id]);
+    }
+    alive.assign(owners.size(), true);
+    path_offsets = reinterpret_cast<const std::uint64_t *>(file->data() + skipped_offsets_start);
+    path_bytes = file->data() + skipped_paths_start;
+    stored = reinterpret_cast<const file_fingerprint *>(file->data() + skipped_fingerprints_start);
+    for (std::uint64_t i = 0; i < header.number_of_skipped; i++) {
+        add_entry(std::string(path_bytes + path_offsets[i], path_offsets[i + 1] - path_offsets[i]), stored[i], SKIPPED);
+    }
+    path_offsets = reinterpret_cast<const std::uint64_t *>(file->data() + copies_offsets_start);
+    path_bytes = file->data() + copies_paths_start;
+    stored = reinterpret_cast<const file_fingerprint *>(file->data() + copies_fingerprints_start);
+    for (std::uint64_t i = 0; i < header.number_of_copies; i++) {
+        file_entry original = owners[originals[i]];
+        entry = add_entry(std::string(path_bytes + path_offsets[i], path_offsets[i + 1] - path_offsets[i]), stored[i], INDEXED);
+        contents.set(entry, contents[original]);
+        add_copy(entry, original);
+    }
+    segment base;
+    base.dictionary = reinterpret_cast<const disk_entry *>(file->data() + dictionary_start);
+    base.dictionary_size = header.number_of_trigrams;
+    base.postings = reinterpret_cast<const std::uint8_t *>(file->data() + postings_start);
+    base.skips = reinterpret_cast<const posting_skip *>(file->data() + skips_start);
+    base.level = BASE;
+    base.file = std::move(file);
+    segments.push_back(std::move(base));
+    return true;
+}
+
+std::string trigram_index::spill_file_name() const {
+    auto now = std::chrono::system_clock::now().time_since_epoch().count();
+    return spill_directory + "/" + std::to_string(now) + "-" + std::to_string(number_of_spills++) + ".spill";
+}
+
+bool trigram_index::write_segment(const std::string &file_name, const std::function<void(postings_writer &)> &fill) {
+    index_writer writer(file_name);
+    if (!writer.out) return false;
+    spill_header header = {};
+    std::memcpy(header.magic, SPILL_MAGIC, sizeof(header.magic));
+    writer.out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    postings_writer lists(writer);
+    fill(lists);
+    header.number_of_skips = lists.skips.size();
+    header.number_of_trigrams = lists.entries.size();
+    header.postings_size = lists.finish();
+    writer.out.seekp(0);
+    writer.out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    writer.out.close();
+    if (!writer.out) {
+        std::remove(file_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+/* the file is removed along with its last mapping, or right away if it cannot be used */
+bool trigram_index::open_segment(const std::string &file_name, unsigned level, segment &result) {
+    std::shared_ptr<const mapped_file> file(new mapped_file(file_name), [file_name] (const mapped_file *f) {
+        delete f;
+        std::remove(file_name.c_str());
+    });
+    spill_header header;
+    if (!file->is_open() || file->size() < sizeof(header)) return false;
+    std::memcpy(&header, file->data(), sizeof(header));
+    std::uint64_t postings_start = sizeof(spill_header);
+    std::uint64_t skips_start = align8(postings_start + header.postings_size);
+    std::uint64_t dictionary_start = skips_start + header.number_of_skips * sizeof(posting_skip);
+    if (std::memcmp(header.magic, SPILL_MAGIC, sizeof(header.magic)) != 0 ||
+            dictionary_start + header.number_of_trigrams * sizeof(disk_entry) != file->size()) {
+        return false;
+    }
+    result.dictionary = reinterpret_cast<const disk_entry *>(file->data() + dictionary_start);
+    result.dictionary_size = header.number_of_trigrams;
+    result.postings = reinterpret_cast<const std::uint8_t *>(file->data() + postings_start);
+    result.skips = reinterpret_cast<const posting_skip *>(file->data() + skips_start);
+    result.level = level;
+    result.file = std::move(file);
+    return true;
+}
+
+/*
+ * The lists in memory go to a new segment as they are. If it cannot be
+ * written, the budget is doubled, so it is not tried again for every file.
+ */
+void trigram_index::spill_if_needed() {
+    finish_merge();
+    if (memory_budget == 0 || memory <= memory_budget) return;
+    std::vector<trigram> codes;
+    codes.reserve(postings.size());
+    for (auto it = postings.begin(); it != postings.end(); ++it) codes.push_back(it->first);
+    std::sort(codes.begin(), codes.end());
+    std::string file_name = spill_file_name();
+    segment spilled;
+    if (!write_segment(file_name, [&] (postings_writer &writer) {
+            for (trigram t : codes) writer.add(t, postings.at(t));
+        }) || !open_segment(file_name, 0, spilled)) {
+        memory_budget *= 2;
+        counters->failed_spills++;
+        return;
+    }
+    segments.push_back(std::move(spilled));
+    postings.clear();
+    memory = 0;
+    counters->spills++;
+    start_merge();
+}
+
+/* merges the newest MERGE_WIDTH segments on a thread of its own if they are spilled and of one level */
+void trigram_index::start_merge() {
+    if (merging.task || segments.size() < MERGE_WIDTH) return;
+    std::size_t first = segments.size() - MERGE_WIDTH;
+    for (std::size_t i = first; i < segments.size(); i++) {
+        if (segments[i].level == BASE || segments[i].level != segments[first].level) return;
+    }
+    merging.task.reset(new merge_task());
+    merge_task *task = merging.task.get();
+    task->inputs.assign(segments.begin() + first, segments.end());
+    task->alive = alive;
+    std::string file_name = spill_file_name();
+    task->thread = std::thread([task, file_name] {
+        std::vector<trigram> codes;
+        for (const segment &s : task->inputs) {
+            for (std::size_t i = 0; i < s.dictionary_size; i++) codes.push_back(s.dictionary[i].code);
+        }
+        std::sort(codes.begin(), codes.end());
+        codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+        task->succeeded = write_segment(file_name, [&] (postings_writer &writer) {
+            posting_view view;
+            for (trigram t : codes) {
+                std::vector<posting_view> parts;
+                for (const segment &s : task->inputs) {
+                    if (s.find(t, view)) parts.push_back(view);
+                }
+                posting_list list;
+                for (posting_cursor cursor(std::move(parts)); cursor.valid(); cursor.next()) {
+                    if (task->alive[cursor.value()]) list.push_back(cursor.value());
+                }
+                if (list.count > 0) writer.add(t, list);
+            }
+        }) && open_segment(file_name, task->inputs[0].level + 1, task->output);
+        task->finished = true;
+    });
+}
+
+/* puts a finished merge in place of its inputs, segments spilled meanwhile stay after it */
+void trigram_index::finish_merge() {
+    if (!merging.task || !merging.task->finished) return;
+    std::unique_ptr<merge_task> task = std::move(merging.task);
+    task->wait();
+    auto first = std::find_if(segments.begin(), segments.end(), [&task] (const segment &s) {
+        return s.file == task->inputs[0].file;
+    });
+    if (!task->succeeded || static_cast<std::size_t>(segments.end() - first) < task->inputs.size()) return;
+    first = segments.erase(first, first + task->inputs.size());
+    segments.insert(first, task->output);
+    counters->merges++;
+    start_merge();
+}
+
+/* a running merge is waited for, its inputs are about to go */
+void trigram_index::drop_segments() {
+    merging.task.reset();
+    segments.clear();
+}
+
+void trigram_index::set_memory_budget(std::size_t budget, const std::string &directory) {
+    memory_budget = budget;
+    spill_directory = directory;
+    spill_if_needed();
+}
+
+tier_stats trigram_index::stats() const {
+    tier_stats result;
+    result.memory = memory;
+    result.memory_budget = memory_budget;
+    result.segments = segments.size();
+    for (const segment &s : segments) result.segment_bytes += s.file->size();
+    result.spills = counters->spills;
+    result.failed_spills = counters->failed_spills;
+    result.merges = counters->merges;
+    result.lookups = counters->lookups;
+    result.memory_hits = counters->memory_hits;
+    result.spilled_hits = counters->spilled_hits;
+    result.base_hits = counters->base_hits;
+    return result;
+}
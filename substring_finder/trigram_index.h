@@ -0,0 +1,366 @@
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+
+#include "trigrams.hpp"
+#include "mapped_file.h"
+#include "file_table.h"
+
+typedef std::uint32_t file_id;
+
+/* size and modification time, enough to tell that a file has not changed since it was indexed */
+struct file_fingerprint {
+    std::int64_t size;
+    std::int64_t modified;
+
+    bool operator==(const file_fingerprint &another) const {
+        return size == another.size && modified == another.modified;
+    }
+    bool operator!=(const file_fingerprint &another) const { return !(*this == another); }
+};
+
+/* XXH64 of a file with its size; files are only compared byte by byte when both match */
+struct content_key {
+    std::int64_t size;
+    std::uint64_t hash;
+
+    bool operator==(const content_key &another) const {
+        return size == another.size && hash == another.hash;
+    }
+};
+
+struct content_key_hash {
+    std::size_t operator()(const content_key &key) const {
+        return static_cast<std::size_t>(key.hash ^ static_cast<std::uint64_t>(key.size) * 0x9E3779B97F4A7C15ull);
+    }
+};
+
+/* part of a file which is indexed as one entry, the last chunk of a file runs to its end */
+struct file_chunk {
+    static const std::uint64_t TO_END_OF_FILE = UINT64_MAX;
+
+    std::uint64_t offset;
+    std::uint64_t size;
+    /* number of newlines before offset */
+    std::uint64_t line;
+    /* number of characters between the start of that line and offset, so no chunk rescans a long line */
+    std::uint64_t column;
+};
+
+struct chunk_trigrams {
+    file_chunk chunk;
+    std::vector<trigram> trigrams;
+};
+
+struct posting_skip {
+    file_id id;
+    std::uint32_t offset;
+};
+
+/* read-only window on an encoded posting list, either in memory or in a mapped index file */
+struct posting_view {
+    const std::uint8_t *data;
+    const posting_skip *skips;
+    std::uint32_t number_of_skips;
+    std::uint32_t count;
+    file_id last;
+};
+
+/* sorted file ids, delta + varint encoded, with a skip entry every SKIP_INTERVAL ids */
+struct posting_list {
+    static const std::uint32_t SKIP_INTERVAL = 64;
+
+    std::vector<std::uint8_t> data;
+    std::vector<posting_skip> skips;
+    file_id last = 0;
+    std::uint32_t count = 0;
+
+    void push_back(file_id id);
+    posting_view view() const;
+};
+
+/*
+ * Forward iterator over the concatenation of posting views with increasing ids,
+ * which can jump over whole skip blocks.
+ */
+class posting_cursor {
+    std::vector<posting_view> parts;
+    std::size_t part;
+    std::uint32_t index;
+    std::uint32_t offset;
+    file_id current;
+    std::uint32_t total;
+
+    void read();
+    void enter(std::size_t part);
+
+public:
+    explicit posting_cursor(std::vector<posting_view> parts);
+
+    bool valid() const { return part < parts.size(); }
+    file_id value() const { return current; }
+    std::uint32_t size() const { return total; }
+
+    void next();
+    /* moves to the first id which is not less than target */
+    bool advance_to(file_id target);
+};
+
+/* how candidates of a query were found, to understand slow queries */
+struct query_plan {
+    /* distinct trigrams of the query, rarest first, and their document frequencies */
+    std::vector<trigram> trigrams;
+    std::vector<std::uint32_t> frequencies;
+    /* number of trigrams from the front which were intersected */
+    std::size_t used = 0;
+    /* expected number of candidates if trigrams occurred independently */
+    double estimated = 0;
+    std::size_t candidates = 0;
+};
+
+/* where posting lists are kept and where lookups found them */
+struct tier_stats {
+    /* bytes of posting lists in memory, and the most that is kept there; 0 means no limit */
+    std::size_t memory = 0;
+    std::size_t memory_budget = 0;
+    /* mapped segments, the loaded index file among them */
+    std::size_t segments = 0;
+    std::uint64_t segment_bytes = 0;
+    std::uint64_t spills = 0;
+    /* spills which could not be written, every one of them doubled the budget */
+    std::uint64_t failed_spills = 0;
+    std::uint64_t merges = 0;
+    /* keys of queries found in any tier, and how many of them each tier held; keys found nowhere are not counted */
+    std::uint64_t lookups = 0;
+    std::uint64_t memory_hits = 0;
+    std::uint64_t spilled_hits = 0;
+    std::uint64_t base_hits = 0;
+};
+
+/*
+ * Inverted index from trigrams to files. It consists of immutable segments,
+ * which are used right from their mappings, and of posting lists in memory
+ * for files added after them. The first segment is the loaded index file; once
+ * the lists in memory outgrow the budget, they are spilled into a segment of
+ * their own, and MERGE_WIDTH spilled segments of one level are merged into one
+ * of the next level in the background, like an LSM tree. New files always get
+ * larger ids than the older ones, so all parts of a list stay sorted.
+ * A large file is split into chunks which get consecutive ids of their own,
+ * an entry of the file table is mapped to the id of its first chunk and the
+ * chunks back to their entry. Files which the caller found to have the same
+ * bytes share the chunks of one of them, its copies are linked from it.
+ * Keys are grams of GRAM_SIZE bytes or tagged shorter ones, see trigrams.hpp.
+ */
+class trigram_index {
+    struct disk_entry {
+        trigram code;
+        std::uint32_t count;
+        std::uint64_t data_offset;
+        std::uint64_t skip_offset;
+        std::uint32_t number_of_skips;
+        file_id last;
+    };
+
+    /* indexed and skipped files, the flags tell which */
+    file_table table;
+    /* first chunk of every entry of the table, NONE if it is not indexed */
+    shared_array<file_id> first_chunks;
+    /* content hash of every entry, 0 if it is not known */
+    shared_array<std::uint64_t> contents;
+    /* next file with the same content as an entry, NONE after the last one */
+    shared_array<file_entry> next_copies;
+    /*
+     * Size and content hash -> the entry which owns the chunks, the one added
+     * last if several do. Only the writer looks files up by content, so copies
+     * of the index, like the snapshots of searches, start without the map and
+     * build it when they are changed.
+     */
+    struct content_owners {
+        std::unordered_map<content_key, file_entry, content_key_hash> owners;
+        bool complete = true;
+
+        content_owners() = default;
+        content_owners(const content_owners &) : complete(false) {}
+        content_owners(content_owners &&) = default;
+        content_owners &operator=(const content_owners &) {
+            owners.clear();
+            complete = false;
+            return *this;
+        }
+        content_owners &operator=(content_owners &&) = default;
+    };
+    content_owners by_content;
+    /* file of every chunk, copies do not own chunks */
+    shared_array<file_entry> owners;
+    shared_array<file_chunk> chunks;
+    shared_array<bool> alive;
+    std::unordered_map<trigram, posting_list> postings;
+    size_t number_of_files = 0;
+    size_t number_of_copies = 0;
+    size_t number_of_dead = 0;
+    /* changes whenever ids are renumbered or files start or stop sharing chunks */
+    std::uint64_t layout = 0;
+
+    struct segment {
+        /* shared by the copies of the index, a spilled file is removed with its last mapping */
+        std::shared_ptr<const mapped_file> file;
+        const disk_entry *dictionary;
+        std::size_t dictionary_size;
+        const std::uint8_t *postings;
+        const posting_skip *skips;
+        /* BASE for the index file, the number of merges behind a spilled segment otherwise */
+        unsigned level;
+
+        bool find(trigram t, posting_view &view) const;
+    };
+    struct postings_writer;
+    struct merge_task;
+    struct tier_counters {
+        std::atomic<std::uint64_t> spills{0};
+        std::atomic<std::uint64_t> failed_spills{0};
+        std::atomic<std::uint64_t> merges{0};
+        std::atomic<std::uint64_t> lookups{0};
+        std::atomic<std::uint64_t> memory_hits{0};
+        std::atomic<std::uint64_t> spilled_hits{0};
+        std::atomic<std::uint64_t> base_hits{0};
+    };
+
+    std::vector<segment> segments;
+    /* bytes held by the lists in memory */
+    std::size_t memory = 0;
+    std::size_t memory_budget = 0;
+    std::string spill_directory;
+    /*
+     * The running merge belongs to the index which started it: copies, like
+     * the snapshots of searches, start without one, so they never wait for it.
+     */
+    struct running_merge {
+        std::unique_ptr<merge_task> task;
+
+        running_merge();
+        running_merge(const running_merge &);
+        running_merge(running_merge &&another);
+        running_merge &operator=(const running_merge &);
+        running_merge &operator=(running_merge &&another);
+        ~running_merge();
+    };
+    running_merge merging;
+    /* shared by the copies of the index, lookups count from any thread */
+    std::shared_ptr<tier_counters> counters = std::make_shared<tier_counters>();
+
+    static const std::uint8_t INDEXED = 2;
+    static const std::uint8_t SKIPPED = 4;
+    static const std::uint8_t COPY = 8;
+    static const file_id NONE = UINT32_MAX;
+    static const unsigned BASE = UINT32_MAX;
+    static const std::size_t MERGE_WIDTH = 4;
+
+    /* queries count where the postings were found */
+    std::vector<posting_view> lookup(trigram t, bool counted = false) const;
+    std::vector<trigram> all_trigrams() const;
+    void add_postings(trigram t, file_id id);
+    std::string spill_file_name() const;
+    static bool write_segment(const std::string &file_name, const std::function<void(postings_writer &)> &fill);
+    static bool open_segment(const std::string &file_name, unsigned level, segment &result);
+    void spill_if_needed();
+    void start_merge();
+    void finish_merge();
+    void drop_segments();
+    file_entry add_entry(const std::string &path, file_fingerprint fingerprint, std::uint8_t flags);
+    void add_copy(file_entry entry, file_entry original);
+    file_fingerprint fingerprint(file_entry entry) const {
+        return {table.size_of(entry), table.modified(entry)};
+    }
+    content_key content(file_entry entry) const { return {table.size_of(entry), contents[entry]}; }
+    std::unordered_map<content_key, file_entry, content_key_hash> &content_map();
+    void compact();
+
+public:
+    static const std::uint32_t FORMAT_VERSION = 8;
+
+    /* replaces previous content of the file if it was indexed, the file is one chunk */
+    file_id add_file(const std::string &path, const std::vector<trigram> &trigrams, file_fingerprint fingerprint = {0, 0});
+    /*
+     * The same for a file split into chunks, which must be ordered by offset;
+     * returns the id of the first one. A content hash other than 0 lets later
+     * files of the same size and bytes become copies of this one.
+     */
+    file_id add_chunks(const std::string &path, const std::vector<chunk_trigrams> &file_chunks,
+                       file_fingerprint fingerprint = {0, 0}, std::uint64_t content = 0);
+    /*
+     * Adds a file which the caller compared byte by byte with the last file
+     * added with this size and content hash, it shares the chunks of that file.
+     * Returns false and adds nothing if there is no such file.
+     */
+    bool add_duplicate(const std::string &path, file_fingerprint fingerprint, std::uint64_t content);
+    /* remembers that the file in this state cannot be indexed */
+    void skip_file(const std::string &path, file_fingerprint fingerprint);
+    /* forgets the file whether it was indexed or skipped */
+    bool remove_file(const std::string &path);
+    bool remove_file(file_entry entry);
+    void clear();
+
+    /* true if the file is indexed or skipped with the same fingerprint */
+    bool is_unchanged(const std::string &path, file_fingerprint fingerprint) const;
+    /* indexed and skipped files */
+    std::vector<std::string> known_files() const;
+    /* copy of fingerprints of indexed and skipped files, to be read from other threads */
+    std::unordered_map<std::string, file_fingerprint> known_fingerprints() const;
+
+    /* the entries of indexed and skipped files, which are used to refer to them */
+    const file_table &entries() const { return table; }
+    file_entry entry(const std::string &path) const { return table.find(path); }
+    bool contains(const std::string &path) const { return contains(table.find(path)); }
+    bool contains(file_entry entry) const { return table.used(entry) && (table.flags(entry) & INDEXED); }
+    std::string path(file_id id) const { return table.path(owners[id]); }
+    file_entry owner(file_id id) const { return owners[id]; }
+    /* the other files which share the chunks of the owner */
+    std::vector<file_entry> copies(file_entry owner) const;
+    const file_chunk &chunk(file_id id) const { return chunks[id]; }
+    /* every id added from now on is at least next_id() until the layout changes */
+    file_id next_id() const { return static_cast<file_id>(owners.size()); }
+    std::uint64_t layout_version() const { return layout; }
+    /* true if the file is indexed and was not changed since next_id() was horizon */
+    bool indexed_before(const std::string &path, file_id horizon) const {
+        file_entry entry = table.find(path);
+        return contains(entry) && first_chunks[entry] < horizon;
+    }
+    size_t size() const { return number_of_files; }
+    /* indexed files which share the chunks of another one */
+    size_t duplicates() const { return number_of_copies; }
+    std::vector<std::string> files() const;
+    /* first chunks of the indexed files, sorted */
+    std::vector<file_id> all_files() const;
+    /* first chunks of the files which have the trigram in any of their chunks, sorted */
+    std::vector<file_id> files_with(trigram t) const;
+
+    /*
+     * Chunks which may contain every trigram. Duplicates are dropped and the
+     * intersection goes from the rarest posting list to the most common one;
+     * it stops once the next list is not expected to drop any candidate.
+     */
+    std::vector<file_id> candidates(const std::vector<trigram> &trigrams, query_plan *plan = nullptr) const;
+    /* chunks which have at least threshold of the trigrams, repeated ones are counted every time */
+    std::vector<file_id> candidates_sharing(const std::vector<trigram> &trigrams, std::size_t threshold) const;
+
+    /*
+     * Posting lists in memory are spilled into files of the directory once
+     * they take more than budget bytes; 0 keeps everything in memory.
+     */
+    void set_memory_budget(std::size_t budget, const std::string &directory);
+    tier_stats stats() const;
+
+    /* writes a versioned, checksummed index file; false if it cannot be written */
+    bool save(const std::string &file_name) const;
+    /* replaces the content with the index file; false if it is missing, stale or corrupt, the content is kept then */
+    bool load(const std::string &file_name);
+};
+
+#endif // TRIGRAM_INDEX_H
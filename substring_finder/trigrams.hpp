@@ -0,0 +1,200 @@
+#ifndef TRIGRAMS_HPP
+#define TRIGRAMS_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#ifndef INDEX_GRAM_SIZE
+#define INDEX_GRAM_SIZE 3
+#endif
+
+/* the length of the indexed grams; a build may set INDEX_GRAM_SIZE to 2 or 4 to compare them */
+constexpr std::size_t GRAM_SIZE = INDEX_GRAM_SIZE;
+static_assert(GRAM_SIZE >= 2 && GRAM_SIZE <= 4, "grams of 2 to 4 bytes are supported");
+
+/*
+ * GRAM_SIZE bytes packed into the low TRIGRAM_BITS, first byte is the most
+ * significant. The name stays for the default size; 4-grams need 64-bit keys
+ * to leave room for the tags above them.
+ */
+typedef std::conditional<GRAM_SIZE < 4, std::uint32_t, std::uint64_t>::type trigram;
+constexpr std::size_t TRIGRAM_BITS = 8 * GRAM_SIZE;
+constexpr trigram TRIGRAM_MASK = (trigram(1) << TRIGRAM_BITS) - 1;
+
+/*
+ * Shorter grams share the key space of full grams above TRIGRAM_BITS, tagged
+ * with the number of bytes they lack, so queries shorter than a gram are
+ * filtered by the same posting lists.
+ */
+constexpr trigram short_gram_tag(std::size_t length) {
+    return trigram(GRAM_SIZE - length) << TRIGRAM_BITS;
+}
+/* any of the grams above taken from case folded text */
+constexpr trigram FOLDED_TAG = trigram(4) << TRIGRAM_BITS;
+
+/* number of bytes of a key, the folded tag aside */
+inline std::size_t gram_length(trigram t) {
+    return GRAM_SIZE - static_cast<std::size_t>((t >> TRIGRAM_BITS) & 3);
+}
+
+/* len bytes packed into the low 8 * len bits, first byte is the most significant */
+inline trigram pack_bytes(char const *str, std::size_t len) {
+    trigram code = 0;
+    for (std::size_t i = 0; i < len; i++) {
+        code = (code << 8) | static_cast<std::uint8_t>(str[i]);
+    }
+    return code;
+}
+
+template<std::size_t N>
+inline trigram pack_gram(char const *str) {
+    static_assert(N >= 1 && N <= GRAM_SIZE, "a gram must fit below the tags");
+    return pack_bytes(str, N);
+}
+
+template<std::size_t N>
+inline std::vector<trigram> query_grams(char const *str, std::size_t len) {
+    std::vector<trigram> result;
+    for (std::size_t i = 0; i + N <= len; i++) {
+        result.push_back(pack_gram<N>(str + i));
+    }
+    return result;
+}
+
+inline trigram pack_trigram(char const *str) {
+    return pack_gram<GRAM_SIZE>(str);
+}
+
+/* index keys of a query: its grams, or one short gram if it is shorter than a gram */
+inline std::vector<trigram> query_trigrams(char const *str, std::size_t len) {
+    if (len >= GRAM_SIZE) return query_grams<GRAM_SIZE>(str, len);
+    if (len > 0) return {short_gram_tag(len) | pack_bytes(str, len)};
+    return {};
+}
+
+/*
+ * Appends the tagged shorter grams of a text to its sorted grams, keeping
+ * them sorted. Every short gram starts a full gram except the ones in the
+ * last GRAM_SIZE - 1 bytes of the text, which are given as tail.
+ */
+inline void add_short_grams(std::vector<trigram> &codes, char const *tail, std::size_t tail_len) {
+    std::vector<trigram> shorter[GRAM_SIZE];
+    for (trigram t : codes) {
+        for (std::size_t length = 1; length < GRAM_SIZE; length++) {
+            trigram g = t >> (8 * (GRAM_SIZE - length));
+            if (shorter[length].empty() || shorter[length].back() != g) shorter[length].push_back(g);
+        }
+    }
+    for (std::size_t i = 0; i < tail_len; i++) {
+        for (std::size_t length = 1; length < GRAM_SIZE && i + length <= tail_len; length++) {
+            std::vector<trigram> &grams = shorter[length];
+            trigram g = pack_bytes(tail + i, length);
+            auto it = std::lower_bound(grams.begin(), grams.end(), g);
+            if (it == grams.end() || *it != g) grams.insert(it, g);
+        }
+    }
+    /* the longer a gram, the smaller its tag */
+    for (std::size_t length = GRAM_SIZE - 1; length > 0; length--) {
+        for (trigram g : shorter[length]) codes.push_back(short_gram_tag(length) | g);
+    }
+}
+
+constexpr std::size_t TRIGRAM_SET_SCAN_SIZE = 1 << 18;
+/* a bitmap of 4-grams would take 512 MiB */
+constexpr bool TRIGRAM_SET_BITMAP = GRAM_SIZE <= 3;
+
+/*
+ * Set of grams of one file: a bitmap over the whole key space of grams (2 MiB
+ * for trigrams) plus the list of codes set in it. Clearing unsets only those
+ * bits, so one set can be reused for many small files without touching all of
+ * its memory. Without the bitmap, codes are deduplicated by sorting whenever
+ * the list grows past TRIGRAM_SET_SCAN_SIZE more entries.
+ */
+class trigram_set {
+    std::vector<std::uint64_t> bitmap;
+    std::vector<trigram> codes;
+    bool sorted_codes = false;
+    std::size_t unique_codes = 0;
+
+    void reset_bits() {
+        if (!TRIGRAM_SET_BITMAP) {
+            unique_codes = 0;
+        } else if (codes.size() >= TRIGRAM_SET_SCAN_SIZE) {
+            std::fill(bitmap.begin(), bitmap.end(), 0);
+        } else {
+            for (trigram c : codes) bitmap[c >> 6] = 0;
+        }
+    }
+
+    void deduplicate() {
+        std::sort(codes.begin(), codes.end());
+        codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+        unique_codes = codes.size();
+    }
+
+public:
+    void insert(trigram t) {
+        insert(&t, 1);
+    }
+
+    void insert(trigram const *first, std::size_t count) {
+        if (!TRIGRAM_SET_BITMAP) {
+            codes.insert(codes.end(), first, first + count);
+            if (codes.size() - unique_codes >= TRIGRAM_SET_SCAN_SIZE) deduplicate();
+            return;
+        }
+        if (bitmap.empty()) bitmap.assign((TRIGRAM_MASK + 1) / 64, 0);
+        for (std::size_t i = 0; i < count; i++) {
+            std::uint64_t &word = bitmap[first[i] >> 6];
+            std::uint64_t bit = std::uint64_t(1) << (first[i] & 63);
+            if (word & bit) continue;
+            word |= bit;
+            codes.push_back(first[i]);
+        }
+    }
+
+    /* must be called before reading the set */
+    void finish() {
+        if (sorted_codes) return;
+        sorted_codes = true;
+        if (!TRIGRAM_SET_BITMAP) {
+            deduplicate();
+            return;
+        }
+        if (codes.size() < TRIGRAM_SET_SCAN_SIZE) {
+            std::sort(codes.begin(), codes.end());
+            return;
+        }
+        codes.clear();
+        for (std::size_t i = 0; i < bitmap.size(); i++) {
+            for (std::uint64_t word = bitmap[i]; word != 0; word &= word - 1) {
+                codes.push_back(static_cast<trigram>(i * 64 + __builtin_ctzll(word)));
+            }
+        }
+    }
+
+    /* empties the set, keeping its memory for the next file */
+    void clear() {
+        reset_bits();
+        codes.clear();
+        sorted_codes = false;
+    }
+
+    /* moves the sorted codes out, the set is left empty */
+    std::vector<trigram> take() {
+        reset_bits();
+        std::vector<trigram> result;
+        result.swap(codes);
+        sorted_codes = false;
+        return result;
+    }
+
+    std::size_t size() const { return codes.size(); }
+    const std::vector<trigram> &sorted() const { return codes; }
+    bool contains(trigram t) const { return std::binary_search(codes.begin(), codes.end(), t); }
+};
+
+#endif // TRIGRAMS_HPP
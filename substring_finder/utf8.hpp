@@ -0,0 +1,43 @@
+#ifndef UTF8_HPP
+#define UTF8_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+/* bytes 10xxxxxx, which never start a character */
+inline bool is_continuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xc0) == 0x80;
+}
+
+/* number of UTF-8 characters in the bytes, a character is counted by its first byte */
+inline std::uint64_t count_characters(char const *begin, char const *end) {
+    return std::count_if(begin, end, [](char c) { return !is_continuation(c); });
+}
+
+inline void append_utf8(std::string &out, std::uint32_t code_point) {
+    if (code_point < 0x80) {
+        out.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+        out.push_back(static_cast<char>(0xc0 | (code_point >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    } else if (code_point < 0x10000) {
+        out.push_back(static_cast<char>(0xe0 | (code_point >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    } else {
+        out.push_back(static_cast<char>(0xf0 | (code_point >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    }
+}
+
+/* the UTF-8 bytes of a code point */
+inline std::string encode_utf8(std::uint32_t code_point) {
+    std::string out;
+    append_utf8(out, code_point);
+    return out;
+}
+
+#endif // UTF8_HPP